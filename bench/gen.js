@@ -0,0 +1,69 @@
+#!/usr/bin/env k8
+
+// Deterministic synthetic inputs for bench/run.sh. The same seed always gives
+// the same bytes, so results from different k8 builds are comparable.
+
+function rng(seed) { // mulberry32; returns a function generating numbers in [0,1)
+	let a = seed >>> 0;
+	return function() {
+		a = (a + 0x6D2B79F5) | 0;
+		let t = Math.imul(a ^ a >>> 15, 1 | a);
+		t = t + Math.imul(t ^ t >>> 7, 61 | t) ^ t;
+		return ((t ^ t >>> 14) >>> 0) / 4294967296;
+	}
+}
+
+const chr_len = [50000000, 40000000, 30000000, 20000000, 10000000];
+
+function gen_fastq(out, n, r) {
+	const nt = "ACGT", ql = "#+5:?@ACEFGHIJ";
+	let s = new Array(150), q = new Array(150);
+	for (let i = 0; i < n; ++i) {
+		const len = r() < 0.1? 50 + Math.floor(r() * 100) : 150; // mostly full-length reads
+		for (let j = 0; j < len; ++j) {
+			const x = r();
+			s[j] = x < 0.002? 'N' : nt[Math.floor(x * 4)];
+			q[j] = ql[Math.floor(r() * ql.length)];
+		}
+		s.length = q.length = len;
+		out.write(`@r${i} ${i&1? 1 : 2}:N:0\n${s.join('')}\n+\n${q.join('')}\n`);
+	}
+}
+
+function gen_bed(out, n, r) {
+	for (let i = 0; i < n; ++i) {
+		const c = Math.floor(r() * chr_len.length);
+		const st = Math.floor(r() * chr_len[c]), len = 100 + Math.floor(r() * r() * 10000);
+		out.write(`chr${c + 1}\t${st}\t${st + len}\n`);
+	}
+}
+
+function gen_tsv(out, n, r) {
+	for (let i = 0; i < n; ++i) {
+		const key = Math.floor(r() * r() * 10000); // skewed so that some keys are frequent
+		out.write(`id${i}\tkey${key}\t${Math.floor(r() * 1000000)}\t${(r() * 100).toFixed(3)}\t${r() < 0.5? "+" : "-"}\n`);
+	}
+}
+
+function main(args) {
+	if (args.length < 3) {
+		warn("Usage: k8 gen.js <fastq|bed|tsv> <count> <seed> [out.txt|out.gz|out.bgz]");
+		warn("Note: out.gz is written in gzip and out.bgz in BGZF");
+		return 1;
+	}
+	const fn = args.length >= 4? args[3] : "-";
+	const mode = /\.bgz$/.test(fn)? "wb" : /\.gz$/.test(fn)? "wz" : "w";
+	const n = parseInt(args[1]), r = rng(parseInt(args[2]));
+	const out = new File(fn, mode);
+	if (args[0] == "fastq") gen_fastq(out, n, r);
+	else if (args[0] == "bed") gen_bed(out, n, r);
+	else if (args[0] == "tsv") gen_tsv(out, n, r);
+	else {
+		warn(`ERROR: unknown format '${args[0]}'`);
+		return 1;
+	}
+	out.close();
+	return 0;
+}
+
+exit(main(arguments));
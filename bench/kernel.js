@@ -0,0 +1,30 @@
+#!/usr/bin/env k8
+
+// Sequence kernel microbenchmark on a deterministic random sequence. The
+// kernels are timed here as generating the input is not part of the workload.
+function main(args) {
+	const len = (args.length > 0? parseInt(args[0]) : 16) << 20, n_rep = args.length > 1? parseInt(args[1]) : 10;
+	const seq = new Uint8Array(len), nt = new Uint8Array(len), packed = new Uint8Array((len + 3) >> 2);
+	const hash = new BigUint64Array(1 << 20), acgt = [65, 67, 71, 84];
+	let x = 11;
+	for (let i = 0; i < len; ++i) { // xorshift32
+		x ^= x << 13, x ^= x >>> 17, x ^= x << 5;
+		seq[i] = acgt[x & 3];
+	}
+	const t0 = Date.now();
+	let gc = 0;
+	for (let r = 0; r < n_rep; ++r) {
+		k8_revcomp(seq);
+		k8_nt4(seq, nt);
+		k8_pack2(seq, packed);
+		gc += k8_count_gcn(seq)[0];
+		for (let i = 0; i < len; i += hash.length) // hash.length k-mers at a time
+			k8_kmer_hash(seq.subarray(i, i + hash.length + 30), 31, hash);
+	}
+	const t = (Date.now() - t0) / 1000;
+	print(gc);
+	warn(`[bench] bytes=${len * n_rep} records=${n_rep} time=${t.toFixed(3)}`);
+	return 0;
+}
+
+exit(main(arguments));
@@ -0,0 +1,12 @@
+#!/usr/bin/env k8
+
+// Output workload: print() with strings, integers and floats
+function main(args) {
+	const n = args.length > 0? parseInt(args[0]) : 1000000;
+	for (let i = 0; i < n; ++i)
+		print(`chr${i % 23 + 1}`, i * 100, i * 100 + 150, "+", i / 7);
+	warn(`[bench] records=${n}`);
+	return 0;
+}
+
+exit(main(arguments));
@@ -0,0 +1,65 @@
+#!/usr/bin/env k8
+
+// Summarize the raw measurements from bench/run.sh as JSON and optionally
+// compare them with a baseline JSON from an earlier run.
+
+function median(a) {
+	const b = a.slice().sort((x, y) => x - y), m = b.length >> 1;
+	return b.length & 1? b[m] : (b[m - 1] + b[m]) / 2;
+}
+
+function read_text(fn) {
+	return k8_decode(k8_read_file(fn));
+}
+
+function main(args) {
+	if (args.length < 1) {
+		warn("Usage: k8 report.js <raw.tsv> [scale] [baseline.json]");
+		return 1;
+	}
+	const scale = args.length >= 2? parseInt(args[1]) : 1;
+	let raw = {}, names = [];
+	for (const line of read_text(args[0]).split("\n")) { // name, rep, wall, rss, bytes, records, time, compressed bytes
+		const t = line.split("\t");
+		if (t.length < 6) continue;
+		if (raw[t[0]] == null) raw[t[0]] = [], names.push(t[0]);
+		raw[t[0]].push({ wall: parseFloat(t[2]), time: t[6]? parseFloat(t[6]) : parseFloat(t[2]), rss: parseFloat(t[3]), bytes: parseFloat(t[4]), records: parseFloat(t[5]), zbytes: t[7]? parseFloat(t[7]) : 0 });
+	}
+	let res = {};
+	for (const name of names) {
+		const a = raw[name], time = median(a.map(x => x.time)), r = { reps: a.length };
+		if (name == "startup") { // 10 invocations per repetition
+			r.startup_ms = +(time * 100).toFixed(2);
+			r.startup_ms_min = +(Math.min(...a.map(x => x.time)) * 100).toFixed(2);
+		} else {
+			r.wall_s = +median(a.map(x => x.wall)).toFixed(3);
+			r.wall_s_min = +Math.min(...a.map(x => x.wall)).toFixed(3);
+			r.time_s = +time.toFixed(3);
+			r.bytes = a[0].bytes; // uncompressed; mb_per_s is based on this
+			r.compressed_bytes = a[0].zbytes;
+			r.records = a[0].records;
+			r.mb_per_s = time > 0? +(r.bytes / 1e6 / time).toFixed(2) : 0;
+			r.records_per_s = time > 0? Math.round(r.records / time) : 0;
+			r.max_rss_mb = +Math.max(...a.map(x => x.rss)).toFixed(1);
+		}
+		res[name] = r;
+	}
+	let out = { k8: k8_version(), scale: scale, results: res };
+	if (args.length >= 3) { // compare with the baseline; ratio >1 means the current build is faster
+		const base = JSON.parse(read_text(args[2]));
+		let cmp = {};
+		for (const name of names) {
+			const b = base.results[name], c = res[name];
+			if (b == null) continue;
+			if (name == "startup") cmp[name] = { speedup: +(b.startup_ms / c.startup_ms).toFixed(3) };
+			else cmp[name] = { speedup: +(b.time_s / c.time_s).toFixed(3), rss_ratio: +(c.max_rss_mb / b.max_rss_mb).toFixed(3) };
+			warn(`[bench] ${name}: ${cmp[name].speedup}x speed` + (cmp[name].rss_ratio != null? `, ${cmp[name].rss_ratio}x RSS` : "") + " vs baseline");
+		}
+		out.baseline = { k8: base.k8, scale: base.scale, comparison: cmp };
+		if (base.scale != scale) warn(`[bench] WARNING: the baseline was run at scale ${base.scale}`);
+	}
+	print(JSON.stringify(out, null, 2));
+	return 0;
+}
+
+exit(main(arguments));
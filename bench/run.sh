@@ -0,0 +1,98 @@
+#!/usr/bin/env bash
+# Usage: bench/run.sh [path/to/k8]; usually invoked by "make bench".
+#
+# Environment variables:
+#   BENCH_DIR       directory for the generated inputs [bench/data]
+#   BENCH_SCALE     multiply the input sizes [1]
+#   BENCH_REPS      repetitions of each workload [3]
+#   BENCH_OUT       JSON output [bench/result.json]
+#   BENCH_BASELINE  a JSON output from an earlier run to compare with
+#   BENCH_FILTER    only run workloads whose names match this regex
+
+set -e
+export LC_ALL=C
+K8=${1:-./k8}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+DIR=${BENCH_DIR:-$ROOT/bench/data}
+SCALE=${BENCH_SCALE:-1}
+REPS=${BENCH_REPS:-3}
+OUT=${BENCH_OUT:-$ROOT/bench/result.json}
+FILTER=${BENCH_FILTER:-.}
+TIMEFORMAT=%3R
+
+case $K8 in */*) K8=$(cd "$(dirname "$K8")" && pwd)/$(basename "$K8");; esac
+mkdir -p "$DIR"
+RAW=$DIR/raw.tsv
+ERR=$DIR/stderr.txt
+
+# generate inputs; a stamp records the scale so that a different scale regenerates them
+if [ ! -f "$DIR/stamp-$SCALE" ]; then
+	rm -f "$DIR"/stamp-*
+	echo "[bench] generating inputs in $DIR at scale $SCALE" >&2
+	"$K8" "$ROOT/bench/gen.js" fastq $((200000 * SCALE)) 1 "$DIR/reads.fq"
+	"$K8" "$ROOT/bench/gen.js" fastq $((200000 * SCALE)) 1 "$DIR/reads.fq.gz"
+	"$K8" "$ROOT/bench/gen.js" fastq $((200000 * SCALE)) 1 "$DIR/reads.fq.bgz"
+	"$K8" "$ROOT/bench/gen.js" bed $((200000 * SCALE)) 2 "$DIR/a.bed"
+	"$K8" "$ROOT/bench/gen.js" bed $((200000 * SCALE)) 3 "$DIR/b.bed"
+	"$K8" "$ROOT/bench/gen.js" tsv $((1000000 * SCALE)) 4 "$DIR/data.tsv"
+	"$K8" "$ROOT/bench/gen.js" tsv $((1000000 * SCALE)) 4 "$DIR/data.tsv.gz"
+	touch "$DIR/stamp-$SCALE"
+fi
+
+# run one workload $REPS times; metrics are taken from the output of --stats
+run() {
+	local name=$1 t
+	shift
+	echo "$name" | grep -Eq "$FILTER" || return 0
+	echo "[bench] $name" >&2
+	for i in $(seq 1 "$REPS"); do
+		t=$( { time "$K8" --stats "$@" > /dev/null 2> "$ERR"; } 2>&1 ) || { cat "$ERR" >&2; exit 1; }
+		awk -v name="$name" -v rep="$i" -v wall="$t" '
+			/^\[k8 stats\] time:/ { for (i = 3; i <= NF; ++i) if ($i ~ /^max_rss=/) { sub(/^max_rss=/, "", $i); sub(/MB$/, "", $i); rss = $i } }
+			/^\[k8 stats\] file / {
+				fn = $4; sub(/:$/, "", fn);
+				if (fn ~ /\.js$/ || fn == "(stderr)") next;
+				for (i = 5; i <= NF; ++i) {
+					split($i, kv, "=");
+					if (fn != "-" && kv[1] == "in") inb += kv[2];
+					else if (fn != "-" && kv[1] == "zin") zin += kv[2];
+					else if (kv[1] == "out") out += kv[2];
+					else if (kv[1] == "lines" || kv[1] == "records") rec += kv[2];
+				}
+			}
+			/^\[bench\]/ { for (i = 2; i <= NF; ++i) { split($i, kv, "="); b[kv[1]] = kv[2] } }
+			END { # throughput is of uncompressed bytes such that plain and gzip inputs are comparable
+				bytes = inb > 0? inb : out;
+				if ("bytes" in b) bytes = b["bytes"];
+				if ("records" in b) rec = b["records"];
+				printf("%s\t%d\t%s\t%s\t%.0f\t%.0f\t%s\t%.0f\n", name, rep, wall, rss, bytes, rec, ("time" in b)? b["time"] : "", zin);
+			}' "$ERR" >> "$RAW"
+	done
+}
+
+# startup time is measured on 10 invocations at a time
+startup() {
+	local t
+	echo "$1" | grep -Eq "$FILTER" || return 0
+	echo "[bench] $1" >&2
+	for i in $(seq 1 "$REPS"); do
+		t=$( { time for j in 1 2 3 4 5 6 7 8 9 10; do "$K8" -e 0 > /dev/null; done; } 2>&1 )
+		printf "%s\t%d\t%s\t0\t0\t10\t\t0\n" "$1" "$i" "$t" >> "$RAW"
+	done
+}
+
+: > "$RAW"
+startup startup
+run lc-plain      "$ROOT/scripts/lc.js" "$DIR/reads.fq"
+run lc-gzip       "$ROOT/scripts/lc.js" "$DIR/reads.fq.gz"
+run fqcnt-gzip    "$ROOT/scripts/fqcnt.js" "$DIR/reads.fq.gz"
+run fqcnt-bgzf    "$ROOT/scripts/fqcnt.js" "$DIR/reads.fq.bgz"
+run bedcov        "$ROOT/scripts/bedcov.js" "$DIR/a.bed" "$DIR/b.bed"
+run tsv-plain     "$ROOT/bench/tsv.js" "$DIR/data.tsv"
+run tsv-gzip      "$ROOT/bench/tsv.js" "$DIR/data.tsv.gz"
+run print         "$ROOT/bench/print.js" $((1000000 * SCALE))
+run kernel        "$ROOT/bench/kernel.js" 16 $((10 * SCALE))
+run sudoku        "$ROOT/scripts/sudoku.js" "$ROOT/test/hard20.txt"
+
+"$K8" "$ROOT/bench/report.js" "$RAW" $SCALE $BENCH_BASELINE > "$OUT"
+echo "[bench] results written to $OUT" >&2
@@ -0,0 +1,32 @@
+#!/usr/bin/env k8
+
+// Time each sequence kernel separately on a deterministic random sequence and
+// print one line per kernel: name and MB/s of input sequence. Each kernel is
+// repeated for at least $sec seconds. Run by bench/simd.sh at each SIMD level.
+function main(args) {
+	const len = (args.length > 0? parseInt(args[0]) : 16) << 20, sec = args.length > 1? parseFloat(args[1]) : 0.5;
+	const seq = new Uint8Array(len), nt = new Uint8Array(len), packed = new Uint8Array((len + 3) >> 2), out = new Uint8Array(len);
+	const hash = new BigUint64Array(1 << 20), acgt = [65, 67, 71, 84];
+	let x = 11;
+	for (let i = 0; i < len; ++i) { // xorshift32
+		x ^= x << 13, x ^= x >>> 17, x ^= x << 5;
+		seq[i] = acgt[x & 3];
+	}
+	const kernels = [
+		["revcomp",   () => k8_revcomp(seq)],
+		["nt4",       () => k8_nt4(seq, nt)],
+		["pack2",     () => k8_pack2(seq, packed)],
+		["unpack2",   () => k8_unpack2(packed, len, out)],
+		["count_gcn", () => k8_count_gcn(seq)],
+		["kmer_hash", () => { for (let i = 0; i < len; i += hash.length) k8_kmer_hash(seq.subarray(i, i + hash.length + 30), 31, hash); }]
+	];
+	for (const [name, f] of kernels) {
+		f(); // warm up
+		let n = 0, t0 = Date.now(), t;
+		do { f(), ++n; } while ((t = (Date.now() - t0) / 1000) < sec);
+		print(name, (len * n / 1e6 / t).toFixed(0));
+	}
+	return 0;
+}
+
+exit(main(arguments));
@@ -0,0 +1,36 @@
+#!/usr/bin/env bash
+# Usage: bench/simd.sh [path/to/k8]; usually invoked by "make bench-simd".
+#
+# Run bench/simd.js under K8_SIMD=scalar, K8_SIMD=ssse3 and the default level
+# and print MB/s of each kernel at each level. The scalar revcomp is the byte
+# loop k8_revcomp() used before the SIMD kernels, so the last column, the
+# speedup of the default level over scalar, compares against the old code.
+#
+# Environment variables:
+#   BENCH_SIMD_MB   sequence length in MB [16]
+#   BENCH_SIMD_SEC  minimum seconds per kernel and level [0.5]
+
+set -e
+K8=${1:-./k8}
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+MB=${BENCH_SIMD_MB:-16}
+SEC=${BENCH_SIMD_SEC:-0.5}
+
+for level in scalar ssse3 default; do
+	if [ $level = default ]; then e=(-u K8_SIMD); else e=(K8_SIMD=$level); fi
+	name=$(env "${e[@]}" "$K8" -v | awk '$1 == "simd:" { print $2 }')
+	env "${e[@]}" "$K8" "$ROOT/bench/simd.js" $MB $SEC | sed "s/^/$name	/"
+done | awk -F'\t' '
+	!($1 in seen_l) { seen_l[$1] = 1; l[nl++] = $1 }
+	!($2 in seen_k) { seen_k[$2] = 1; k[nk++] = $2 }
+	{ v[$1, $2] = $3 }
+	END { # levels not supported by the CPU fall back and are printed once
+		printf("%-10s", "kernel");
+		for (i = 0; i < nl; ++i) printf("\t%s", l[i]);
+		printf("\tspeedup\n");
+		for (j = 0; j < nk; ++j) {
+			printf("%-10s", k[j]);
+			for (i = 0; i < nl; ++i) printf("\t%s", v[l[i], k[j]]);
+			printf("\t%.2f\n", v[l[0], k[j]] > 0? v[l[nl-1], k[j]] / v[l[0], k[j]] : 0);
+		}
+	}'
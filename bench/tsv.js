@@ -0,0 +1,23 @@
+#!/usr/bin/env k8
+
+// TSV workload: split lines, count keys and sum numeric columns
+function main(args) {
+	if (args.length == 0) {
+		warn("Usage: k8 tsv.js <in.tsv>");
+		return 1;
+	}
+	const file = new File(args[0]), buf = new Bytes(), off = new Int32Array(10), cnt = new ByteCounter();
+	let n = 0, sum = 0, fsum = 0;
+	while (file.readline(buf) >= 0) {
+		if (buf.fields(1, off) < 4) continue;
+		cnt.inc(buf, 1, off[2], off[3]);
+		sum += buf.parseInt(off[4], off[5]);
+		fsum += buf.parseFloat(off[6], off[7]);
+		++n;
+	}
+	file.close();
+	print(n, cnt.size, sum, fsum.toFixed(3));
+	return 0;
+}
+
+exit(main(arguments));
@@ -31,16 +31,33 @@
 #include <assert.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <math.h>
 #include <zlib.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <immintrin.h>
+#elif defined(__aarch64__)
+#include <arm_neon.h>
+#endif
 
 #include "include/v8-context.h"
 #include "include/v8-exception.h"
+#include "include/v8-function.h"
 #include "include/v8-initialization.h"
 #include "include/v8-isolate.h"
 #include "include/v8-local-handle.h"
 #include "include/v8-script.h"
+#include "include/v8-snapshot.h"
+#include "include/v8-profiler.h"
 #include "include/v8-container.h"
 #include "include/v8-template.h"
+#include "include/v8-typed-array.h"
 #include "include/libplatform/libplatform.h"
 
 /**************************
@@ -79,6 +96,15 @@
 #endif
 
 static char *k8_src_path = 0;
+static int k8_making_snapshot = 0;
+static int k8_stats_on = 0; // --stats
+
+static inline double k8_realtime(void) // monotonic wall-clock time in seconds
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
 
 typedef struct {
 	int64_t l, m;
@@ -88,343 +114,2353 @@ typedef struct {
 typedef struct {
 	uint64_t magic;
 	kstring_t buf;
+	int64_t n_ext; // memory reported to V8
+	v8::Global<v8::Object> *ref; // weak reference to the JS object
 } k8_bytes_t;
 
-/****************
- *** File I/O ***
- ****************/
+/********************
+ *** SIMD kernels ***
+ ********************/
 
-#define KS_SEP_SPACE 0
-#define KS_SEP_TAB   1
-#define KS_SEP_LINE  2
+const char k8_comp_tab[] = {
+	  0,   1,	2,	 3,	  4,   5,	6,	 7,	  8,   9,  10,	11,	 12,  13,  14,	15,
+	 16,  17,  18,	19,	 20,  21,  22,	23,	 24,  25,  26,	27,	 28,  29,  30,	31,
+	 32,  33,  34,	35,	 36,  37,  38,	39,	 40,  41,  42,	43,	 44,  45,  46,	47,
+	 48,  49,  50,	51,	 52,  53,  54,	55,	 56,  57,  58,	59,	 60,  61,  62,	63,
+	 64, 'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D', 'I', 'J', 'M', 'L', 'K', 'N', 'O',
+	'P', 'Q', 'Y', 'S', 'A', 'A', 'B', 'W', 'X', 'R', 'Z',	91,	 92,  93,  94,	95,
+	 64, 't', 'v', 'g', 'h', 'e', 'f', 'c', 'd', 'i', 'j', 'm', 'l', 'k', 'n', 'o',
+	'p', 'q', 'y', 's', 'a', 'a', 'b', 'w', 'x', 'r', 'z', 123, 124, 125, 126, 127
+};
 
-typedef struct {
-	uint64_t magic;
-	gzFile fp;
-	FILE *fpw;
-	int32_t st, en, buf_size, enc, last_char;
-	int32_t is_eof:16, is_fastq:16;
-	uint8_t *buf;
-} k8_file_t;
+static uint8_t k8_nt4_tab[256]; // A/C/G/T/U to 0/1/2/3, case insensitive; others to 4
+static uint32_t k8_unpack2_tab[256]; // a packed byte to four bases
 
-#define ks_err(ks) ((ks)->en < 0)
-#define ks_eof(ks) ((ks)->is_eof && (ks)->st >= (ks)->en)
+#define K8_BSET_MAX 16
+
+typedef struct { // a set of delimiters; a byte x is in the set if lo[x&15]&hi[x>>4] is nonzero, when all bytes are below 128
+	int32_t n, ascii;
+	uint8_t c[K8_BSET_MAX], lo[16], hi[16];
+} k8_bset_t;
+
+static k8_bset_t k8_bset_space, k8_bset_tab; // for KS_SEP_SPACE and KS_SEP_TAB
 
-static k8_file_t *ks_open(int fd, const char *fn, const char *mode)
+typedef struct { // kernels chosen at runtime; the SIMD versions only speed up common cases and produce the same results
+	const char *name;
+	void (*revcomp)(uint8_t *seq, int64_t len); // reverse complement in place
+	void (*nt4)(const uint8_t *seq, int64_t len, uint8_t *out); // $out may be $seq
+	void (*pack2)(const uint8_t *seq, int64_t len, uint8_t *out); // four bases per byte, the first base at the lowest bits
+	void (*count_gcn)(const uint8_t *seq, int64_t len, int64_t cnt[2]); // number of G/C and N
+	void (*hash64)(uint64_t *a, int64_t n, uint64_t mask); // k8_hash64() in place; UINT64_MAX is kept
+	int64_t (*find)(const uint8_t *p, int64_t len, const k8_bset_t *s); // position of the first byte in $s, or $len if absent
+} k8_sk_t;
+
+static k8_sk_t k8_sk;
+static pthread_once_t k8_sk_once = PTHREAD_ONCE_INIT;
+
+static inline uint8_t k8_comp1(uint8_t c) { return c < 128? k8_comp_tab[c] : c; }
+
+static inline uint64_t k8_hash64(uint64_t key, uint64_t mask) // invertible integer hash; from minimap2
 {
-	gzFile fp = 0;
-	FILE *fpw = 0;
-	int32_t write_file = (mode && (strchr(mode, 'w') || strchr(mode, 'a')) && strchr(mode, 'r') == 0);
-	if (fd >= 0) {
-		if (write_file) fpw = fdopen(fd, mode);
-		else fp = gzdopen(fd, "r");
-	} else if (fn) {
-		if (write_file) fpw = strcmp(fn, "-")? fopen(fn, mode) : stdout;
-		else fp = strcmp(fn, "-")? gzopen(fn, "r") : gzdopen(0, "r");
-	} else {
-		if (write_file) fpw = stdout;
-		else fp = gzdopen(0, "r");
-	}
-	if (fp == 0 && fpw == 0) return 0;
-	k8_file_t *ks = K8_CALLOC(k8_file_t, 1);
-	ks->magic = K8_FILE_MAGIC;
-	ks->fp = fp, ks->fpw = fpw;
-	if (fp) {
-		ks->buf_size = 0x40000;
-		ks->buf = K8_CALLOC(uint8_t, ks->buf_size);
+	key = (~key + (key << 21)) & mask;
+	key = key ^ key >> 24;
+	key = ((key + (key << 3)) + (key << 8)) & mask;
+	key = key ^ key >> 14;
+	key = ((key + (key << 2)) + (key << 4)) & mask;
+	key = key ^ key >> 28;
+	key = (key + (key << 31)) & mask;
+	return key;
+}
+
+static void k8_sk_revcomp_range(uint8_t *seq, int64_t len, int64_t i0, int64_t i1) // swap and complement seq[i] and seq[len-1-i] for i in [i0,i1)
+{
+	for (int64_t i = i0; i < i1; ++i) {
+		uint8_t tmp = seq[len - 1 - i];
+		seq[len - 1 - i] = k8_comp1(seq[i]);
+		seq[i] = k8_comp1(tmp);
 	}
-	return ks;
 }
 
-static void ks_close(k8_file_t *ks)
+static void k8_sk_revcomp_sc(uint8_t *seq, int64_t len)
 {
-	if (ks == 0) return;
-	if (ks->fp) gzclose(ks->fp);
-	if (ks->fpw) fclose(ks->fpw);
-	free(ks->buf);
-	memset(ks, 0, sizeof(*ks));
-	free(ks);
+	k8_sk_revcomp_range(seq, len, 0, len>>1);
+	if (len & 1) seq[len>>1] = k8_comp1(seq[len>>1]);
 }
 
-static inline int32_t ks_getc(k8_file_t *ks)
+static void k8_sk_nt4_sc(const uint8_t *seq, int64_t len, uint8_t *out)
 {
-	if (ks_err(ks)) return -3;
-	if (ks_eof(ks)) return -1;
-	if (ks->st >= ks->en) {
-		ks->st = 0;
-		ks->en = gzread(ks->fp, ks->buf, ks->buf_size);
-		if (ks->en == 0) { ks->is_eof = 1; return -1; }
-		else if (ks->en < 0) { ks->is_eof = 1; return -3; }
-	}
-	return (int32_t)ks->buf[ks->st++];
+	for (int64_t i = 0; i < len; ++i)
+		out[i] = k8_nt4_tab[seq[i]];
 }
 
-static int64_t ks_read(k8_file_t *ks, uint8_t *buf, int64_t len)
+static void k8_sk_pack2_range(const uint8_t *seq, int64_t i0, int64_t len, uint8_t *out) // $i0 is a multiple of 4
 {
-	int64_t off = 0;
-	if (ks->is_eof && ks->st >= ks->en) return 0;
-	while (len > ks->en - ks->st) {
-		int64_t l = ks->en - ks->st;
-		if (l > 0) {
-			memcpy(buf + off, ks->buf + ks->st, l);
-			len -= l; off += l;
-		}
-		ks->st = 0;
-		ks->en = gzread(ks->fp, ks->buf, ks->buf_size);
-		if (ks->en < ks->buf_size) ks->is_eof = 1;
-		if (ks->en == 0) return off;
-		else if (ks->en < 0) return -3; // gzread error
+	for (int64_t i = i0; i < len; i += 4) {
+		uint8_t x = 0;
+		for (int64_t j = 0; j < 4 && i + j < len; ++j)
+			x |= (k8_nt4_tab[seq[i + j]] & 3) << (j * 2);
+		out[i>>2] = x;
 	}
-	memcpy(buf + off, ks->buf + ks->st, len);
-	ks->st += len;
-	return off + len;
 }
 
-static int64_t ks_read_all(k8_file_t *ks, kstring_t *str)
+static void k8_sk_pack2_sc(const uint8_t *seq, int64_t len, uint8_t *out) { k8_sk_pack2_range(seq, 0, len, out); }
+
+static void k8_sk_count_gcn_sc(const uint8_t *seq, int64_t len, int64_t cnt[2])
 {
-	str->l = 0;
-	while (!ks_eof(ks)) {
-		int64_t l = ks->en - ks->st;
-		if (l > 0) {
-			K8_GROW(uint8_t, str->s, str->l + l, str->m);
-			memcpy(&str->s[str->l], &ks->buf[ks->st], l);
-			str->l += l;
-		}
-		ks->st = 0;
-		ks->en = gzread(ks->fp, ks->buf, ks->buf_size);
-		if (ks->en < ks->buf_size) ks->is_eof = 1;
-		if (ks->en <= 0) break;
+	for (int64_t i = 0; i < len; ++i) {
+		uint8_t c = seq[i] | 0x20;
+		cnt[0] += (c == 'c' || c == 'g');
+		cnt[1] += (c == 'n');
 	}
-	str->s[str->l] = 0; // always enough room due to K8_GROW() is requesting on extra byte
-	return str->l;
 }
 
-static int64_t ks_getuntil2(k8_file_t *ks, int delimiter, kstring_t *str, int *dret, int append)
+static void k8_sk_hash64_sc(uint64_t *a, int64_t n, uint64_t mask)
 {
-	int gotany = 0;
-	if (dret) *dret = 0;
-	str->l = append? str->l : 0;
-	for (;;) {
-		int i = 0;
-		if (ks_err(ks)) return -3;
-		if (ks->st >= ks->en) {
-			if (!ks->is_eof) {
-				ks->st = 0;
-				ks->en = gzread(ks->fp, ks->buf, ks->buf_size);
-				if (ks->en == 0) { ks->is_eof = 1; break; }
-				if (ks->en == -1) { ks->is_eof = 1; return -3; }
-			} else break;
-		}
-		if (delimiter == KS_SEP_LINE) {
-			unsigned char *sep = (unsigned char*)memchr(ks->buf + ks->st, '\n', ks->en - ks->st);
-			i = sep != NULL ? sep - ks->buf : ks->en;
-		} else if (delimiter == KS_SEP_SPACE) {
-			for (i = ks->st; i < ks->en; ++i)
-				if (ks->buf[i] == ' ' || ks->buf[i] == '\t' || ks->buf[i] == '\n') break;
-		} else if (delimiter == KS_SEP_TAB) {
-			for (i = ks->st; i < ks->en; ++i)
-				if (ks->buf[i] == '\t' || ks->buf[i] == '\n') break;
-		} else if (delimiter > 0) {
-			for (i = ks->st; i < ks->en; ++i)
-				if (ks->buf[i] == delimiter) break;
-		} else abort();
-		K8_GROW(uint8_t, str->s, str->l + (i - ks->st), str->m);
-		gotany = 1;
-		memcpy(str->s + str->l, ks->buf + ks->st, i - ks->st);
-		str->l = str->l + (i - ks->st);
-		ks->st = i + 1;
-		if (i < ks->en) {
-			if (dret) *dret = ks->buf[i];
-			break;
-		}
+	for (int64_t i = 0; i < n; ++i)
+		if (a[i] != UINT64_MAX) a[i] = k8_hash64(a[i], mask);
+}
+
+static void k8_bset_init(k8_bset_t *s, const uint8_t *c, int32_t n) // at most K8_BSET_MAX bytes; duplicates are dropped
+{
+	int32_t i, j;
+	memset(s, 0, sizeof(k8_bset_t));
+	s->ascii = 1;
+	for (i = 0; i < n && s->n < K8_BSET_MAX; ++i) {
+		for (j = 0; j < s->n; ++j)
+			if (s->c[j] == c[i]) break;
+		if (j < s->n) continue;
+		s->c[s->n++] = c[i];
+		if (c[i] >= 128) s->ascii = 0;
+		else s->hi[c[i]>>4] |= 1<<(c[i]>>4), s->lo[c[i]&15] |= 1<<(c[i]>>4); // one bit per high nibble
 	}
-	if (!gotany && ks_eof(ks)) return -1;
-	if (str->s == 0) {
-		str->m = 1;
-		str->s = K8_CALLOC(uint8_t, 1);
-	} else if (delimiter == KS_SEP_LINE && str->l > 1 && str->s[str->l-1] == '\r') {
-		--str->l;
+}
+
+static int64_t k8_sk_find_sc(const uint8_t *p, int64_t len, const k8_bset_t *s)
+{
+	int64_t i;
+	if (s->ascii) {
+		for (i = 0; i < len; ++i)
+			if (p[i] < 128 && (s->lo[p[i]&15] & s->hi[p[i]>>4])) break;
+	} else {
+		for (i = 0; i < len; ++i)
+			if (memchr(s->c, p[i], s->n)) break;
 	}
-	str->s[str->l] = '\0';
-	return str->l;
+	return i;
 }
 
-/*******************************
- *** Fundamental v8 routines ***
- *******************************/
+// For A/C/G/T/U/N in either case, the low 4 bits are distinct and select the expected letter (ORed with 0x20),
+// the complement (XORed with the letter) and the nt4 code with a byte shuffle. U is left to the scalar revcomp.
+#define K8_SK_TAB_EXPECT -1,'a',-1,'c','t','u',-1,'g',-1,-1,-1,-1,-1,-1,'n',-1
+#define K8_SK_TAB_RC_OK  -1,'a',-1,'c','t',-1,-1,'g',-1,-1,-1,-1,-1,-1,'n',-1
+#define K8_SK_TAB_XOR    0,0x15,0,0x04,0x15,0,0,0x04,0,0,0,0,0,0,0,0
+#define K8_SK_TAB_NT4    4,0,4,1,3,3,4,2,4,4,4,4,4,4,4,4
+#define K8_SK_TAB_REV    15,14,13,12,11,10,9,8,7,6,5,4,3,2,1,0
 
-#define K8_SAVE_PTR(_args, _index, _ptr)  (_args).This()->SetAlignedPointerInInternalField(_index, (void*)(_ptr))
-#define K8_LOAD_PTR(_args, _index, _type) ((_type*)(_args).This()->GetAlignedPointerFromInternalField(_index))
+#ifdef __x86_64__
+#define K8_SSSE3 __attribute__((target("ssse3")))
+#define K8_AVX2  __attribute__((target("avx2")))
 
-static inline const char *k8_cstr(const v8::String::Utf8Value &str) // Convert a v8 string to C string
+K8_SSSE3 static inline __m128i k8_sk_ok_ssse3(__m128i x, __m128i lo) // 0xff for bases handled by the SIMD revcomp
 {
-	return *str? *str : "<N/A>";
+	const __m128i expect = _mm_setr_epi8(K8_SK_TAB_RC_OK);
+	return _mm_cmpeq_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_shuffle_epi8(expect, lo));
 }
 
-static void k8_exception(v8::Isolate* isolate, v8::TryCatch* try_catch) // Exception handling. Adapted from v8/shell.cc
+K8_SSSE3 static void k8_sk_revcomp_ssse3_from(uint8_t *seq, int64_t len, int64_t i)
 {
-	v8::HandleScope handle_scope(isolate);
-	v8::String::Utf8Value exception(isolate, try_catch->Exception());
-	const char* exception_string = k8_cstr(exception);
-	v8::Local<v8::Message> message = try_catch->Message();
-	if (message.IsEmpty()) {
-		// v8 didn't provide any extra information about this error; just print the exception.
-		fprintf(stderr, "%s\n", exception_string);
-	} else {
-		// Print (filename):(line number): (message).
-		v8::String::Utf8Value filename(isolate, message->GetScriptOrigin().ResourceName());
-		v8::Local<v8::Context> context(isolate->GetCurrentContext());
-		const char* filename_string = k8_cstr(filename);
-		int linenum = message->GetLineNumber(context).FromJust();
-		fprintf(stderr, "%s:%i: %s\n", filename_string, linenum, exception_string);
-		// Print line of source code.
-		v8::String::Utf8Value sourceline(isolate, message->GetSourceLine(context).ToLocalChecked());
-		const char* sourceline_string = k8_cstr(sourceline);
-		fprintf(stderr, "%s\n", sourceline_string);
-		// Print wavy underline (GetUnderline is deprecated).
-		int start = message->GetStartColumn(context).FromJust();
-		for (int i = 0; i < start; i++) fputc(' ', stderr);
-		int end = message->GetEndColumn(context).FromJust();
-		for (int i = start; i < end; i++) fputc('^', stderr);
-		fputc('\n', stderr);
-		v8::Local<v8::Value> stack_trace_string;
-		if (try_catch->StackTrace(context).ToLocal(&stack_trace_string) &&
-				stack_trace_string->IsString() &&
-				stack_trace_string.As<v8::String>()->Length() > 0)
-		{
-			v8::String::Utf8Value stack_trace(isolate, stack_trace_string);
-			const char* err = k8_cstr(stack_trace);
-			fputs(err, stderr); fputc('\n', stderr);
+	const __m128i xtab = _mm_setr_epi8(K8_SK_TAB_XOR), rev = _mm_setr_epi8(K8_SK_TAB_REV), m4 = _mm_set1_epi8(0x0f);
+	for (; 2 * (i + 16) <= len; i += 16) {
+		uint8_t *p = seq + i, *q = seq + len - i - 16;
+		__m128i x = _mm_loadu_si128((__m128i*)p), y = _mm_loadu_si128((__m128i*)q);
+		__m128i lx = _mm_and_si128(x, m4), ly = _mm_and_si128(y, m4);
+		if (_mm_movemask_epi8(_mm_and_si128(k8_sk_ok_ssse3(x, lx), k8_sk_ok_ssse3(y, ly))) != 0xffff) {
+			k8_sk_revcomp_range(seq, len, i, i + 16);
+			continue;
 		}
+		x = _mm_shuffle_epi8(_mm_xor_si128(x, _mm_shuffle_epi8(xtab, lx)), rev);
+		y = _mm_shuffle_epi8(_mm_xor_si128(y, _mm_shuffle_epi8(xtab, ly)), rev);
+		_mm_storeu_si128((__m128i*)p, y);
+		_mm_storeu_si128((__m128i*)q, x);
 	}
+	k8_sk_revcomp_range(seq, len, i, len>>1);
+	if (len & 1) seq[len>>1] = k8_comp1(seq[len>>1]);
 }
 
-static bool k8_execute(v8::Isolate* isolate, v8::Local<v8::String> source, v8::Local<v8::Value> name, bool prt_rst) // Execute JS in a string. Adapted from v8/shell.cc
+K8_SSSE3 static void k8_sk_revcomp_ssse3(uint8_t *seq, int64_t len) { k8_sk_revcomp_ssse3_from(seq, len, 0); }
+
+K8_SSSE3 static inline __m128i k8_sk_nt4_16(__m128i x)
 {
-	v8::HandleScope handle_scope(isolate);
-	v8::TryCatch try_catch(isolate);
-	v8::ScriptOrigin origin(isolate, name);
-	v8::Local<v8::Context> context(isolate->GetCurrentContext());
-	v8::Local<v8::Script> script;
-	if (!v8::Script::Compile(context, source, &origin).ToLocal(&script)) {
-		k8_exception(isolate, &try_catch);
-		return false;
-	} else {
-		v8::Local<v8::Value> result;
-		if (!script->Run(context).ToLocal(&result)) {
-			assert(try_catch.HasCaught());
-			k8_exception(isolate, &try_catch);
-			return false;
-		} else {
-			assert(!try_catch.HasCaught());
-			if (prt_rst && !result->IsUndefined()) {
-				// If all went well and the result wasn't undefined then print the returned value.
-				v8::String::Utf8Value str(isolate, result);
-				puts(k8_cstr(str));
-			}
-			return true;
-		}
+	const __m128i expect = _mm_setr_epi8(K8_SK_TAB_EXPECT), code = _mm_setr_epi8(K8_SK_TAB_NT4);
+	__m128i lo = _mm_and_si128(x, _mm_set1_epi8(0x0f));
+	__m128i ok = _mm_cmpeq_epi8(_mm_or_si128(x, _mm_set1_epi8(0x20)), _mm_shuffle_epi8(expect, lo));
+	return _mm_or_si128(_mm_and_si128(ok, _mm_shuffle_epi8(code, lo)), _mm_andnot_si128(ok, _mm_set1_epi8(4)));
+}
+
+K8_SSSE3 static void k8_sk_nt4_ssse3(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	int64_t i;
+	for (i = 0; i + 16 <= len; i += 16)
+		_mm_storeu_si128((__m128i*)(out + i), k8_sk_nt4_16(_mm_loadu_si128((const __m128i*)(seq + i))));
+	k8_sk_nt4_sc(seq + i, len - i, out + i);
+}
+
+K8_SSSE3 static void k8_sk_pack2_ssse3(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	const __m128i gather = _mm_setr_epi8(0,4,8,12,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+	int64_t i;
+	for (i = 0; i + 16 <= len; i += 16) {
+		__m128i x = _mm_and_si128(k8_sk_nt4_16(_mm_loadu_si128((const __m128i*)(seq + i))), _mm_set1_epi8(3));
+		x = _mm_maddubs_epi16(x, _mm_set1_epi16(0x0401)); // c0 + c1*4 in each 16-bit word
+		x = _mm_madd_epi16(x, _mm_set1_epi32(0x00100001)); // w0 + w1*16 in each 32-bit word
+		int32_t y = _mm_cvtsi128_si32(_mm_shuffle_epi8(x, gather));
+		memcpy(out + (i>>2), &y, 4);
 	}
+	k8_sk_pack2_range(seq, i, len, out);
 }
 
-v8::MaybeLocal<v8::String> k8_readfile(v8::Isolate* isolate, const char *name) // Read an entire file. Adapted from v8/shell.cc
+K8_SSSE3 static void k8_sk_count_gcn_ssse3(const uint8_t *seq, int64_t len, int64_t cnt[2])
 {
-	kstring_t str = {0,0,0};
-	k8_file_t *ks = ks_open(-1, name, 0);
-	if (ks == 0) {
-		fprintf(stderr, "ERROR: fail to open file '%s'.\n", name);
-		return v8::Handle<v8::String>();
+	const __m128i lc = _mm_set1_epi8(0x20), c = _mm_set1_epi8('c'), g = _mm_set1_epi8('g'), n = _mm_set1_epi8('n'), z = _mm_setzero_si128();
+	int64_t i = 0;
+	while (i + 16 <= len) { // byte counters are summed up every 255 iterations
+		__m128i a_gc = z, a_n = z;
+		for (int32_t j = 0; j < 255 && i + 16 <= len; ++j, i += 16) {
+			__m128i x = _mm_or_si128(_mm_loadu_si128((const __m128i*)(seq + i)), lc);
+			a_gc = _mm_sub_epi8(a_gc, _mm_or_si128(_mm_cmpeq_epi8(x, c), _mm_cmpeq_epi8(x, g)));
+			a_n = _mm_sub_epi8(a_n, _mm_cmpeq_epi8(x, n));
+		}
+		a_gc = _mm_sad_epu8(a_gc, z), a_n = _mm_sad_epu8(a_n, z);
+		cnt[0] += _mm_cvtsi128_si64(a_gc) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(a_gc, a_gc));
+		cnt[1] += _mm_cvtsi128_si64(a_n) + _mm_cvtsi128_si64(_mm_unpackhi_epi64(a_n, a_n));
 	}
-	ks_read_all(ks, &str);
-	ks_close(ks);
+	k8_sk_count_gcn_sc(seq + i, len - i, cnt);
+}
 
-	if (str.l > 2 && strncmp((char*)str.s, "#!", 2) == 0) { // then skip the "#!" line
-		int64_t i;
-		for (i = 0; i < str.l; ++i)
-			if (str.s[i] == '\n') break;
-		str.l -= i + 1;
-		memmove(str.s, &str.s[i+1], str.l);
+K8_SSSE3 static void k8_sk_hash64_ssse3(uint64_t *a, int64_t n, uint64_t mask)
+{
+	const __m128i m = _mm_set1_epi64x(mask), ones = _mm_set1_epi32(-1);
+	int64_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		__m128i x = _mm_loadu_si128((__m128i*)(a + i)), k = x, e;
+		k = _mm_and_si128(_mm_add_epi64(_mm_xor_si128(k, ones), _mm_slli_epi64(k, 21)), m);
+		k = _mm_xor_si128(k, _mm_srli_epi64(k, 24));
+		k = _mm_and_si128(_mm_add_epi64(_mm_add_epi64(k, _mm_slli_epi64(k, 3)), _mm_slli_epi64(k, 8)), m);
+		k = _mm_xor_si128(k, _mm_srli_epi64(k, 14));
+		k = _mm_and_si128(_mm_add_epi64(_mm_add_epi64(k, _mm_slli_epi64(k, 2)), _mm_slli_epi64(k, 4)), m);
+		k = _mm_xor_si128(k, _mm_srli_epi64(k, 28));
+		k = _mm_and_si128(_mm_add_epi64(k, _mm_slli_epi64(k, 31)), m);
+		e = _mm_cmpeq_epi32(x, ones);
+		e = _mm_and_si128(e, _mm_shuffle_epi32(e, 0xb1)); // 64-bit equality without SSE4.1
+		_mm_storeu_si128((__m128i*)(a + i), _mm_or_si128(k, e));
 	}
-	v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(isolate, (char*)str.s, v8::NewStringType::kNormal, str.l);
-	free(str.s);
-	return result;
+	k8_sk_hash64_sc(a + i, n - i, mask);
 }
 
-/******************************
- *** New built-in functions ***
- ******************************/
+K8_SSSE3 static int64_t k8_sk_find_ssse3(const uint8_t *p, int64_t len, const k8_bset_t *s)
+{
+	const __m128i lo = _mm_loadu_si128((const __m128i*)s->lo), hi = _mm_loadu_si128((const __m128i*)s->hi), m4 = _mm_set1_epi8(0x0f), z = _mm_setzero_si128();
+	int64_t i;
+	if (!s->ascii) return k8_sk_find_sc(p, len, s);
+	for (i = 0; i + 16 <= len; i += 16) { // the high nibble of a byte>=128 selects 0 in $hi
+		__m128i x = _mm_loadu_si128((const __m128i*)(p + i));
+		__m128i y = _mm_and_si128(_mm_shuffle_epi8(lo, _mm_and_si128(x, m4)), _mm_shuffle_epi8(hi, _mm_and_si128(_mm_srli_epi16(x, 4), m4)));
+		int32_t mask = _mm_movemask_epi8(_mm_cmpeq_epi8(y, z)) ^ 0xffff;
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + k8_sk_find_sc(p + i, len - i, s);
+}
 
-static void k8_write_string(FILE *fp, const v8::FunctionCallbackInfo<v8::Value> &args, int32_t i, kstring_t *buf)
+K8_AVX2 static void k8_sk_revcomp_avx2(uint8_t *seq, int64_t len)
 {
-	v8::HandleScope handle_scope(args.GetIsolate());
-	if (args[i]->IsString()) {
-		int64_t len = args[i].As<v8::String>()->Length();
-		if (len > 0) {
-			K8_GROW(uint8_t, buf->s, len, buf->m);
-			args[i].As<v8::String>()->WriteOneByte(args.GetIsolate(), buf->s);
-			fwrite(buf->s, 1, len, fp);
-		}
-		return;
-	} else if (args[i]->IsArrayBuffer()) {
-		void *data = args[i].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
-		int64_t len = args[i].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
-		if (len > 0) fwrite(data, 1, len, fp);
-		return;
-	} else if (args[i]->IsObject()) {
-		if (args[i].As<v8::Object>()->InternalFieldCount() > 0) {
-			k8_bytes_t *a = (k8_bytes_t*)args[i].As<v8::Object>()->GetAlignedPointerFromInternalField(0);
-			if (a && a->magic == K8_BYTES_MAGIC) {
-				if (a->buf.l > 0) fwrite(a->buf.s, 1, a->buf.l, fp);
-				return;
-			}
+	const __m256i xtab = _mm256_setr_epi8(K8_SK_TAB_XOR, K8_SK_TAB_XOR), expect = _mm256_setr_epi8(K8_SK_TAB_RC_OK, K8_SK_TAB_RC_OK);
+	const __m256i rev = _mm256_setr_epi8(K8_SK_TAB_REV, K8_SK_TAB_REV), m4 = _mm256_set1_epi8(0x0f), lc = _mm256_set1_epi8(0x20);
+	int64_t i;
+	for (i = 0; 2 * (i + 32) <= len; i += 32) {
+		uint8_t *p = seq + i, *q = seq + len - i - 32;
+		__m256i x = _mm256_loadu_si256((__m256i*)p), y = _mm256_loadu_si256((__m256i*)q);
+		__m256i lx = _mm256_and_si256(x, m4), ly = _mm256_and_si256(y, m4);
+		__m256i ok = _mm256_and_si256(_mm256_cmpeq_epi8(_mm256_or_si256(x, lc), _mm256_shuffle_epi8(expect, lx)),
+		                              _mm256_cmpeq_epi8(_mm256_or_si256(y, lc), _mm256_shuffle_epi8(expect, ly)));
+		if (_mm256_movemask_epi8(ok) != -1) {
+			k8_sk_revcomp_range(seq, len, i, i + 32);
+			continue;
 		}
+		x = _mm256_shuffle_epi8(_mm256_xor_si256(x, _mm256_shuffle_epi8(xtab, lx)), rev);
+		y = _mm256_shuffle_epi8(_mm256_xor_si256(y, _mm256_shuffle_epi8(xtab, ly)), rev);
+		_mm256_storeu_si256((__m256i*)p, _mm256_permute4x64_epi64(y, 0x4e)); // swap the two 128-bit lanes
+		_mm256_storeu_si256((__m256i*)q, _mm256_permute4x64_epi64(x, 0x4e));
 	}
-	v8::String::Utf8Value str(args.GetIsolate(), args[i]);
-	fputs(k8_cstr(str), fp);
+	k8_sk_revcomp_ssse3_from(seq, len, i);
 }
 
-static void k8_print(const v8::FunctionCallbackInfo<v8::Value> &args) // print(): print to stdout; TAB demilited if multiple arguments are provided
+K8_AVX2 static inline __m256i k8_sk_nt4_32(__m256i x)
 {
-	kstring_t buf = {0,0,0};
-	for (int32_t i = 0; i < args.Length(); i++) {
-		if (i) fputc('\t', stdout);
-		k8_write_string(stdout, args, i, &buf);
+	const __m256i expect = _mm256_setr_epi8(K8_SK_TAB_EXPECT, K8_SK_TAB_EXPECT), code = _mm256_setr_epi8(K8_SK_TAB_NT4, K8_SK_TAB_NT4);
+	__m256i lo = _mm256_and_si256(x, _mm256_set1_epi8(0x0f));
+	__m256i ok = _mm256_cmpeq_epi8(_mm256_or_si256(x, _mm256_set1_epi8(0x20)), _mm256_shuffle_epi8(expect, lo));
+	return _mm256_blendv_epi8(_mm256_set1_epi8(4), _mm256_shuffle_epi8(code, lo), ok);
+}
+
+K8_AVX2 static void k8_sk_nt4_avx2(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	int64_t i;
+	for (i = 0; i + 32 <= len; i += 32)
+		_mm256_storeu_si256((__m256i*)(out + i), k8_sk_nt4_32(_mm256_loadu_si256((const __m256i*)(seq + i))));
+	k8_sk_nt4_ssse3(seq + i, len - i, out + i);
+}
+
+K8_AVX2 static void k8_sk_pack2_avx2(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	const __m256i gather = _mm256_setr_epi8(0,4,8,12,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1, 0,4,8,12,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1,-1);
+	int64_t i;
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_and_si256(k8_sk_nt4_32(_mm256_loadu_si256((const __m256i*)(seq + i))), _mm256_set1_epi8(3));
+		x = _mm256_maddubs_epi16(x, _mm256_set1_epi16(0x0401));
+		x = _mm256_madd_epi16(x, _mm256_set1_epi32(0x00100001));
+		x = _mm256_permutevar8x32_epi32(_mm256_shuffle_epi8(x, gather), _mm256_setr_epi32(0,4,0,0,0,0,0,0));
+		int64_t y = _mm_cvtsi128_si64(_mm256_castsi256_si128(x));
+		memcpy(out + (i>>2), &y, 8);
 	}
-	fputc('\n', stdout);
-	if (buf.s) free(buf.s);
+	k8_sk_pack2_range(seq, i, len, out);
 }
 
-static void k8_warn(const v8::FunctionCallbackInfo<v8::Value> &args) // warn(): similar print() but print to stderr
+K8_AVX2 static void k8_sk_count_gcn_avx2(const uint8_t *seq, int64_t len, int64_t cnt[2])
 {
-	kstring_t buf = {0,0,0};
-	for (int32_t i = 0; i < args.Length(); i++) {
-		if (i) fputc('\t', stderr);
-		k8_write_string(stderr, args, i, &buf);
+	const __m256i lc = _mm256_set1_epi8(0x20), c = _mm256_set1_epi8('c'), g = _mm256_set1_epi8('g'), n = _mm256_set1_epi8('n'), z = _mm256_setzero_si256();
+	int64_t i = 0;
+	while (i + 32 <= len) {
+		__m256i a_gc = z, a_n = z;
+		for (int32_t j = 0; j < 255 && i + 32 <= len; ++j, i += 32) {
+			__m256i x = _mm256_or_si256(_mm256_loadu_si256((const __m256i*)(seq + i)), lc);
+			a_gc = _mm256_sub_epi8(a_gc, _mm256_or_si256(_mm256_cmpeq_epi8(x, c), _mm256_cmpeq_epi8(x, g)));
+			a_n = _mm256_sub_epi8(a_n, _mm256_cmpeq_epi8(x, n));
+		}
+		a_gc = _mm256_sad_epu8(a_gc, z), a_n = _mm256_sad_epu8(a_n, z);
+		cnt[0] += _mm256_extract_epi64(a_gc, 0) + _mm256_extract_epi64(a_gc, 1) + _mm256_extract_epi64(a_gc, 2) + _mm256_extract_epi64(a_gc, 3);
+		cnt[1] += _mm256_extract_epi64(a_n, 0) + _mm256_extract_epi64(a_n, 1) + _mm256_extract_epi64(a_n, 2) + _mm256_extract_epi64(a_n, 3);
 	}
-	fputc('\n', stderr);
-	if (buf.s) free(buf.s);
+	k8_sk_count_gcn_sc(seq + i, len - i, cnt);
 }
 
-static void k8_exit(const v8::FunctionCallbackInfo<v8::Value> &args)
+K8_AVX2 static void k8_sk_hash64_avx2(uint64_t *a, int64_t n, uint64_t mask)
 {
-	v8::HandleScope handle_scope(args.GetIsolate());
-	int exit_code = args[0]->Int32Value(args.GetIsolate()->GetCurrentContext()).FromMaybe(0);
-	fflush(stdout); fflush(stderr);
-	exit(exit_code);
+	const __m256i m = _mm256_set1_epi64x(mask), ones = _mm256_set1_epi32(-1);
+	int64_t i;
+	for (i = 0; i + 4 <= n; i += 4) {
+		__m256i x = _mm256_loadu_si256((__m256i*)(a + i)), k = x;
+		k = _mm256_and_si256(_mm256_add_epi64(_mm256_xor_si256(k, ones), _mm256_slli_epi64(k, 21)), m);
+		k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 24));
+		k = _mm256_and_si256(_mm256_add_epi64(_mm256_add_epi64(k, _mm256_slli_epi64(k, 3)), _mm256_slli_epi64(k, 8)), m);
+		k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 14));
+		k = _mm256_and_si256(_mm256_add_epi64(_mm256_add_epi64(k, _mm256_slli_epi64(k, 2)), _mm256_slli_epi64(k, 4)), m);
+		k = _mm256_xor_si256(k, _mm256_srli_epi64(k, 28));
+		k = _mm256_and_si256(_mm256_add_epi64(k, _mm256_slli_epi64(k, 31)), m);
+		_mm256_storeu_si256((__m256i*)(a + i), _mm256_or_si256(k, _mm256_cmpeq_epi64(x, ones)));
+	}
+	k8_sk_hash64_sc(a + i, n - i, mask);
+}
+K8_AVX2 static int64_t k8_sk_find_avx2(const uint8_t *p, int64_t len, const k8_bset_t *s)
+{
+	const __m256i lo = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->lo)), hi = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)s->hi));
+	const __m256i m4 = _mm256_set1_epi8(0x0f), z = _mm256_setzero_si256();
+	int64_t i;
+	if (!s->ascii) return k8_sk_find_sc(p, len, s);
+	for (i = 0; i + 32 <= len; i += 32) {
+		__m256i x = _mm256_loadu_si256((const __m256i*)(p + i));
+		__m256i y = _mm256_and_si256(_mm256_shuffle_epi8(lo, _mm256_and_si256(x, m4)), _mm256_shuffle_epi8(hi, _mm256_and_si256(_mm256_srli_epi16(x, 4), m4)));
+		uint32_t mask = ~(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(y, z));
+		if (mask) return i + __builtin_ctz(mask);
+	}
+	return i + k8_sk_find_ssse3(p + i, len - i, s);
 }
+#endif // __x86_64__
 
-static void k8_load(const v8::FunctionCallbackInfo<v8::Value> &args) // load(): Load and execute a JS file. It also searches ONE path in $K8_PATH
+#ifdef __aarch64__
+static inline uint8x16_t k8_sk_ok_neon(uint8x16_t x, uint8x16_t lo)
 {
-	char *env_path = getenv("K8_PATH");
-	char abspath[K8_PATH_MAX+1], buf[K8_PATH_MAX+1];
-	FILE *fp;
-	int32_t k;
-	realpath(k8_src_path, abspath);
-	for (k = strlen(abspath) - 1; k >= 0; --k)
-		if (abspath[k] == '/') break;
-	assert(k >= 0);
-	abspath[++k] = 0;
-	for (int i = 0; i < args.Length(); i++) {
+	static const uint8_t expect[16] = { 0xff,'a',0xff,'c','t',0xff,0xff,'g',0xff,0xff,0xff,0xff,0xff,0xff,'n',0xff }; // no 'u'; see K8_SK_TAB_RC_OK
+	return vceqq_u8(vorrq_u8(x, vdupq_n_u8(0x20)), vqtbl1q_u8(vld1q_u8(expect), lo));
+}
+
+static inline uint8x16_t k8_sk_rc16_neon(uint8x16_t x, uint8x16_t lo)
+{
+	static const uint8_t xtab[16] = { K8_SK_TAB_XOR };
+	x = veorq_u8(x, vqtbl1q_u8(vld1q_u8(xtab), lo));
+	x = vrev64q_u8(x);
+	return vextq_u8(x, x, 8);
+}
+
+static void k8_sk_revcomp_neon(uint8_t *seq, int64_t len)
+{
+	int64_t i;
+	for (i = 0; 2 * (i + 16) <= len; i += 16) {
+		uint8_t *p = seq + i, *q = seq + len - i - 16;
+		uint8x16_t x = vld1q_u8(p), y = vld1q_u8(q);
+		uint8x16_t lx = vandq_u8(x, vdupq_n_u8(0x0f)), ly = vandq_u8(y, vdupq_n_u8(0x0f));
+		if (vminvq_u8(vandq_u8(k8_sk_ok_neon(x, lx), k8_sk_ok_neon(y, ly))) != 0xff) {
+			k8_sk_revcomp_range(seq, len, i, i + 16);
+			continue;
+		}
+		vst1q_u8(p, k8_sk_rc16_neon(y, ly));
+		vst1q_u8(q, k8_sk_rc16_neon(x, lx));
+	}
+	k8_sk_revcomp_range(seq, len, i, len>>1);
+	if (len & 1) seq[len>>1] = k8_comp1(seq[len>>1]);
+}
+
+static inline uint8x16_t k8_sk_nt4_16(uint8x16_t x)
+{
+	static const uint8_t expect[16] = { 0xff,'a',0xff,'c','t','u',0xff,'g',0xff,0xff,0xff,0xff,0xff,0xff,'n',0xff }, code[16] = { K8_SK_TAB_NT4 };
+	uint8x16_t lo = vandq_u8(x, vdupq_n_u8(0x0f));
+	uint8x16_t ok = vceqq_u8(vorrq_u8(x, vdupq_n_u8(0x20)), vqtbl1q_u8(vld1q_u8(expect), lo));
+	return vbslq_u8(ok, vqtbl1q_u8(vld1q_u8(code), lo), vdupq_n_u8(4));
+}
+
+static void k8_sk_nt4_neon(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	int64_t i;
+	for (i = 0; i + 16 <= len; i += 16)
+		vst1q_u8(out + i, k8_sk_nt4_16(vld1q_u8(seq + i)));
+	k8_sk_nt4_sc(seq + i, len - i, out + i);
+}
+
+static void k8_sk_pack2_neon(const uint8_t *seq, int64_t len, uint8_t *out)
+{
+	int64_t i;
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t x = vandq_u8(k8_sk_nt4_16(vld1q_u8(seq + i)), vdupq_n_u8(3));
+		uint16x8_t y = vreinterpretq_u16_u8(x);
+		y = vorrq_u16(vandq_u16(y, vdupq_n_u16(0xff)), vshrq_n_u16(y, 6)); // c0 | c1<<2 in each 16-bit word
+		uint32x4_t z = vreinterpretq_u32_u16(y);
+		z = vorrq_u32(vandq_u32(z, vdupq_n_u32(0xffff)), vshrq_n_u32(z, 12)); // w0 | w1<<4
+		uint8x8_t b = vmovn_u16(vcombine_u16(vmovn_u32(z), vmovn_u32(z)));
+		vst1_lane_u32((uint32_t*)(out + (i>>2)), vreinterpret_u32_u8(b), 0);
+	}
+	k8_sk_pack2_range(seq, i, len, out);
+}
+
+static void k8_sk_count_gcn_neon(const uint8_t *seq, int64_t len, int64_t cnt[2])
+{
+	int64_t i = 0;
+	while (i + 16 <= len) {
+		uint8x16_t a_gc = vdupq_n_u8(0), a_n = vdupq_n_u8(0);
+		for (int32_t j = 0; j < 255 && i + 16 <= len; ++j, i += 16) {
+			uint8x16_t x = vorrq_u8(vld1q_u8(seq + i), vdupq_n_u8(0x20));
+			a_gc = vsubq_u8(a_gc, vorrq_u8(vceqq_u8(x, vdupq_n_u8('c')), vceqq_u8(x, vdupq_n_u8('g'))));
+			a_n = vsubq_u8(a_n, vceqq_u8(x, vdupq_n_u8('n')));
+		}
+		cnt[0] += vaddlvq_u8(a_gc), cnt[1] += vaddlvq_u8(a_n);
+	}
+	k8_sk_count_gcn_sc(seq + i, len - i, cnt);
+}
+
+static void k8_sk_hash64_neon(uint64_t *a, int64_t n, uint64_t mask)
+{
+	const uint64x2_t m = vdupq_n_u64(mask), ones = vdupq_n_u64(UINT64_MAX);
+	int64_t i;
+	for (i = 0; i + 2 <= n; i += 2) {
+		uint64x2_t x = vld1q_u64(a + i), k = x;
+		k = vandq_u64(vaddq_u64(veorq_u64(k, ones), vshlq_n_u64(k, 21)), m);
+		k = veorq_u64(k, vshrq_n_u64(k, 24));
+		k = vandq_u64(vaddq_u64(vaddq_u64(k, vshlq_n_u64(k, 3)), vshlq_n_u64(k, 8)), m);
+		k = veorq_u64(k, vshrq_n_u64(k, 14));
+		k = vandq_u64(vaddq_u64(vaddq_u64(k, vshlq_n_u64(k, 2)), vshlq_n_u64(k, 4)), m);
+		k = veorq_u64(k, vshrq_n_u64(k, 28));
+		k = vandq_u64(vaddq_u64(k, vshlq_n_u64(k, 31)), m);
+		vst1q_u64(a + i, vorrq_u64(k, vceqq_u64(x, ones)));
+	}
+	k8_sk_hash64_sc(a + i, n - i, mask);
+}
+static int64_t k8_sk_find_neon(const uint8_t *p, int64_t len, const k8_bset_t *s)
+{
+	const uint8x16_t lo = vld1q_u8(s->lo), hi = vld1q_u8(s->hi), m4 = vdupq_n_u8(0x0f);
+	int64_t i;
+	if (!s->ascii) return k8_sk_find_sc(p, len, s);
+	for (i = 0; i + 16 <= len; i += 16) {
+		uint8x16_t x = vld1q_u8(p + i);
+		uint8x16_t y = vtstq_u8(vqtbl1q_u8(lo, vandq_u8(x, m4)), vqtbl1q_u8(hi, vshrq_n_u8(x, 4)));
+		uint64_t mask = vget_lane_u64(vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(y), 4)), 0); // 4 bits per byte
+		if (mask) return i + (__builtin_ctzll(mask) >> 2);
+	}
+	return i + k8_sk_find_sc(p + i, len - i, s);
+}
+#endif // __aarch64__
+
+static void k8_sk_init(void) // choose kernels by the CPU; $K8_SIMD may cap the level at "scalar" (or "0") or "ssse3"
+{
+	const char *env = getenv("K8_SIMD");
+	int32_t i, j, simd = env == 0? 2 : strcmp(env, "0") == 0 || strcmp(env, "scalar") == 0? 0 : strcmp(env, "ssse3") == 0? 1 : 2;
+	memset(k8_nt4_tab, 4, 256);
+	for (i = 0; i < 5; ++i)
+		k8_nt4_tab[(uint8_t)"ACGTU"[i]] = k8_nt4_tab[(uint8_t)"acgtu"[i]] = i < 4? i : 3;
+	for (i = 0; i < 256; ++i) {
+		uint8_t *p = (uint8_t*)&k8_unpack2_tab[i];
+		for (j = 0; j < 4; ++j) p[j] = "ACGT"[i >> (j * 2) & 3];
+	}
+	k8_sk.name = "scalar";
+	k8_sk.revcomp = k8_sk_revcomp_sc, k8_sk.nt4 = k8_sk_nt4_sc, k8_sk.pack2 = k8_sk_pack2_sc;
+	k8_sk.count_gcn = k8_sk_count_gcn_sc, k8_sk.hash64 = k8_sk_hash64_sc, k8_sk.find = k8_sk_find_sc;
+	k8_bset_init(&k8_bset_space, (const uint8_t*)" \t\n", 3);
+	k8_bset_init(&k8_bset_tab, (const uint8_t*)"\t\n", 2);
+	if (simd == 0) return;
+#if defined(__x86_64__)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("ssse3")) {
+		k8_sk.name = "ssse3";
+		k8_sk.revcomp = k8_sk_revcomp_ssse3, k8_sk.nt4 = k8_sk_nt4_ssse3, k8_sk.pack2 = k8_sk_pack2_ssse3;
+		k8_sk.count_gcn = k8_sk_count_gcn_ssse3, k8_sk.hash64 = k8_sk_hash64_ssse3, k8_sk.find = k8_sk_find_ssse3;
+	}
+	if (simd >= 2 && __builtin_cpu_supports("avx2")) {
+		k8_sk.name = "avx2";
+		k8_sk.revcomp = k8_sk_revcomp_avx2, k8_sk.nt4 = k8_sk_nt4_avx2, k8_sk.pack2 = k8_sk_pack2_avx2;
+		k8_sk.count_gcn = k8_sk_count_gcn_avx2, k8_sk.hash64 = k8_sk_hash64_avx2, k8_sk.find = k8_sk_find_avx2;
+	}
+#elif defined(__aarch64__)
+	k8_sk.name = "neon";
+	k8_sk.revcomp = k8_sk_revcomp_neon, k8_sk.nt4 = k8_sk_nt4_neon, k8_sk.pack2 = k8_sk_pack2_neon;
+	k8_sk.count_gcn = k8_sk_count_gcn_neon, k8_sk.hash64 = k8_sk_hash64_neon, k8_sk.find = k8_sk_find_neon;
+#endif
+}
+
+static inline const k8_sk_t *k8_sk_get(void)
+{
+	pthread_once(&k8_sk_once, k8_sk_init);
+	return &k8_sk;
+}
+
+static inline int64_t k8_bset_find(const k8_sk_t *sk, const uint8_t *p, int64_t len, const k8_bset_t *s)
+{
+	if (s->n == 1) {
+		const uint8_t *q = (const uint8_t*)memchr(p, s->c[0], len);
+		return q? q - p : len;
+	}
+	return sk->find(p, len, s);
+}
+
+static void k8_sk_unpack2(const uint8_t *packed, int64_t len, uint8_t *out) // $len bases to A/C/G/T
+{
+	int64_t i;
+	for (i = 0; i + 4 <= len; i += 4)
+		memcpy(out + i, &k8_unpack2_tab[packed[i>>2]], 4);
+	for (; i < len; ++i)
+		out[i] = "ACGT"[packed[i>>2] >> ((i&3) * 2) & 3];
+}
+
+static int64_t k8_sk_kmer(const k8_sk_t *sk, const uint8_t *seq, int64_t len, int32_t k, uint64_t *out, int64_t max) // hashes of canonical k-mers at each position; UINT64_MAX if there are non-ACGT bases
+{
+	uint8_t buf[4096];
+	uint64_t mask = k < 32? (1ULL<<2*k) - 1 : UINT64_MAX, fwd = 0, rev = 0;
+	int32_t shift = 2 * (k - 1), l = 0;
+	int64_t i, n = len >= k? len - k + 1 : 0, j;
+	if (max > n) max = n;
+	for (i = 0; i < len && i < max + k - 1; i += sizeof(buf)) { // by blocks such that the SIMD kernels work on data in cache
+		int64_t b = len - i < (int64_t)sizeof(buf)? len - i : sizeof(buf), x0 = -1, x1 = 0;
+		sk->nt4(seq + i, b, buf);
+		for (j = 0; j < b; ++j) {
+			uint64_t c = buf[j];
+			if (c < 4) {
+				fwd = (fwd << 2 | c) & mask;
+				rev = rev >> 2 | (3ULL ^ c) << shift;
+				++l;
+			} else l = 0;
+			int64_t x = i + j - (k - 1); // where the k-mer starts
+			if (x >= 0 && x < max) {
+				out[x] = l >= k? (fwd < rev? fwd : rev) : UINT64_MAX;
+				if (x0 < 0) x0 = x;
+				x1 = x + 1;
+			}
+		}
+		if (x0 >= 0) sk->hash64(out + x0, x1 - x0, mask);
+	}
+	return n;
+}
+
+/****************
+ *** File I/O ***
+ ****************/
+
+#define KS_SEP_SPACE 0
+#define KS_SEP_TAB   1
+#define KS_SEP_LINE  2
+
+#define KS_PF_N_BUF 4
+
+typedef struct { // prefetcher: a worker thread inflating into a ring of buffers
+	pthread_t tid;
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+	gzFile fp;
+	int32_t buf_size, i_read, i_write, n_filled, holding, stop;
+	int64_t c_off; // compressed bytes consumed by gzread()
+	int32_t len[KS_PF_N_BUF];
+	uint8_t *buf[KS_PF_N_BUF];
+} ks_pf_t;
+
+#define KS_BGZF_BLK_SIZE 0x10000
+#define KS_BGZF_N_BLK    8 // number of BGZF blocks decompressed together by a worker
+
+typedef struct {
+	int32_t state, len, n_blk; // state: 0 for free, 1 for being decompressed and 2 for ready
+	int32_t blk_len[KS_BGZF_N_BLK], blk_ulen[KS_BGZF_N_BLK]; // compressed and decompressed block sizes
+	int64_t blk_off[KS_BGZF_N_BLK], c_end; // file offsets of the blocks and of the end of the batch, for virtual offsets
+	uint8_t *cbuf, *buf; // compressed and decompressed data
+} ks_bgzf_slot_t;
+
+typedef struct { // BGZF reader: workers decompress batches of blocks; batches are consumed in order. Without workers, the reader decompresses
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+	FILE *fp;
+	int32_t n_threads, n_slot, holding, stop, eof, err;
+	int32_t max_blk; // blocks per batch; reset to 1 by ks_bgzf_seek() and doubled per batch, so that random access inflates little
+	int64_t seq_read, seq_next; // the next batch to give to the reader and to read from the file, respectively
+	int64_t c_read, c_off; // compressed bytes read from the file and the current file offset
+	int64_t tail_off; // offset of a gzip member that is not BGZF, at which reading stopped; -1 if none
+	z_stream zs; // for decompression in the reading thread when n_threads == 0
+	pthread_t *tid;
+	ks_bgzf_slot_t *slot;
+} ks_bgzf_t;
+
+#define KS_BGZF_IN_SIZE  0xff00 // max input size of a BGZF block such that the compressed block always fits
+#define KS_ZW_JOB_SIZE   (KS_BGZF_IN_SIZE * KS_BGZF_N_BLK) // size of uncompressed data compressed by a worker at a time
+
+typedef struct {
+	int32_t state, l_in, l_out; // state: 0 for free, 1 for waiting to be compressed, 2 for being compressed and 3 for compressed
+	uint8_t *in, *out;
+} ks_zw_slot_t;
+
+typedef struct { // compressed writer: jobs are compressed by workers and written in order by the writing thread
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+	FILE *fp;
+	int32_t is_bgzf, level, n_threads, n_slot, stop, err, m_out, finished;
+	int64_t seq_fill, seq_comp, seq_write; // the next job to fill, to compress and to write, respectively
+	int64_t c_written; // compressed bytes written
+	z_stream zs; // for compression in the writing thread when n_threads == 0
+	pthread_t *tid;
+	ks_zw_slot_t *slot;
+} ks_zw_t;
+
+typedef struct { // I/O statistics reported by File.prototype.stats() and --stats
+	int64_t n_fill, n_flush; // number of input buffer refills and of raw writes
+	int64_t n_in, n_out; // uncompressed bytes read into the input buffer and written out of the output buffer
+	int64_t z_in, z_out; // bytes read from and written to the file; only updated by ks_stat_sync()
+	int64_t n_line, n_rec; // lines or tokens from readline()/readlines() and records from readFastx()
+	double t_fill, t_flush; // seconds spent in refilling (gzread() or waiting for inflating threads) and in writing
+} ks_stat_t;
+
+typedef struct {
+	uint64_t magic;
+	char *fn; // file name for --stats
+	pthread_t tid; // the thread that opened the file
+	gzFile fp;
+	FILE *fpw;
+	int32_t st, en, buf_size, enc, last_char;
+	int32_t is_eof:16, is_fastq:16;
+	int32_t bz_tail; // a gzip member that is not BGZF follows BGZF blocks, as in "cat a.bgz b.gz"; read with gzread() and not seekable
+	uint8_t *buf;
+	uint8_t *mm; // memory mapped uncompressed file
+	int64_t mm_len, mm_off;
+	int64_t u_pos; // uncompressed offset of buf[0]; not used for BGZF
+	int64_t n_gzi, *gzi; // BGZF index: n_gzi pairs of compressed and uncompressed offsets at block starts
+	ks_pf_t *pf;
+	ks_bgzf_t *bz;
+	ks_zw_t *zw;
+	int64_t out_size; // flush the output buffer when it would exceed this size
+	int32_t out_sync; // flush after each print() or write()
+	kstring_t out; // output buffer
+	int32_t n_sep; // number of bytes in sep_str; 0 if $sep is not set
+	uint8_t sep_str[K8_BSET_MAX]; // the delimiter string given to readline(), from which $sep was built
+	k8_bset_t sep;
+	int64_t n_ext; // memory reported to V8
+	ks_stat_t stat;
+	v8::Global<v8::Object> *ref; // weak reference to the JS object
+} k8_file_t;
+
+#define KS_OUT_SIZE 0x10000
+
+static __thread k8_file_t *ks_std_buf[2]; // per-thread buffers for stdout and stderr; the stdout buffer is shared by print() and File objects on stdout
+
+#define ks_err(ks) ((ks)->en < 0)
+#define ks_eof(ks) ((ks)->is_eof && (ks)->st >= (ks)->en)
+
+static void *ks_pf_worker(void *data)
+{
+	ks_pf_t *pf = (ks_pf_t*)data;
+	for (;;) {
+		int32_t i, len;
+		pthread_mutex_lock(&pf->lock);
+		while (pf->n_filled == KS_PF_N_BUF && !pf->stop)
+			pthread_cond_wait(&pf->cv, &pf->lock);
+		if (pf->stop) {
+			pthread_mutex_unlock(&pf->lock);
+			break;
+		}
+		i = pf->i_write;
+		pthread_mutex_unlock(&pf->lock);
+		len = gzread(pf->fp, pf->buf[i], pf->buf_size); // slot $i is not visible to the reader until n_filled is increased
+		pthread_mutex_lock(&pf->lock);
+		pf->len[i] = len, pf->c_off = gzoffset(pf->fp);
+		pf->i_write = (i + 1) % KS_PF_N_BUF;
+		++pf->n_filled;
+		pthread_cond_broadcast(&pf->cv);
+		pthread_mutex_unlock(&pf->lock);
+		if (len <= 0) break; // EOF or error; the last slot is kept by ks_pf_next() forever
+	}
+	return 0;
+}
+
+static ks_pf_t *ks_pf_init(gzFile fp, int32_t buf_size)
+{
+	ks_pf_t *pf = K8_CALLOC(ks_pf_t, 1);
+	pf->fp = fp, pf->buf_size = buf_size;
+	for (int32_t i = 0; i < KS_PF_N_BUF; ++i)
+		pf->buf[i] = K8_CALLOC(uint8_t, buf_size);
+	pthread_mutex_init(&pf->lock, 0);
+	pthread_cond_init(&pf->cv, 0);
+	pthread_create(&pf->tid, 0, ks_pf_worker, pf);
+	return pf;
+}
+
+static void ks_pf_destroy(ks_pf_t *pf)
+{
+	pthread_mutex_lock(&pf->lock);
+	pf->stop = 1;
+	pthread_cond_broadcast(&pf->cv);
+	pthread_mutex_unlock(&pf->lock);
+	pthread_join(pf->tid, 0);
+	pthread_mutex_destroy(&pf->lock);
+	pthread_cond_destroy(&pf->cv);
+	for (int32_t i = 0; i < KS_PF_N_BUF; ++i) free(pf->buf[i]);
+	free(pf);
+}
+
+static int32_t ks_pf_next(ks_pf_t *pf, uint8_t **buf) // release the current buffer and wait for the next one; return value is the same as gzread()
+{
+	int32_t len;
+	pthread_mutex_lock(&pf->lock);
+	if (pf->holding && pf->len[pf->i_read] > 0) { // give the previous buffer back to the worker
+		pf->i_read = (pf->i_read + 1) % KS_PF_N_BUF;
+		--pf->n_filled, pf->holding = 0;
+		pthread_cond_broadcast(&pf->cv);
+	}
+	while (pf->n_filled == 0)
+		pthread_cond_wait(&pf->cv, &pf->lock);
+	pf->holding = 1;
+	*buf = pf->buf[pf->i_read];
+	len = pf->len[pf->i_read];
+	pthread_mutex_unlock(&pf->lock);
+	return len;
+}
+
+static FILE *ks_bgzf_check(const char *fn) // return an opened FILE at offset 0 if $fn is BGZF compressed, or NULL otherwise
+{
+	uint8_t h[16];
+	FILE *fp = fopen(fn, "rb");
+	if (fp == 0) return 0;
+	if (fread(h, 1, 16, fp) == 16 && h[0] == 31 && h[1] == 139 && h[2] == 8 && (h[3]&4) && h[10] == 6 && h[11] == 0
+			&& h[12] == 'B' && h[13] == 'C' && h[14] == 2 && h[15] == 0) {
+		rewind(fp);
+		return fp;
+	}
+	fclose(fp);
+	return 0;
+}
+
+static int32_t ks_bgzf_read_block(FILE *fp, uint8_t *blk) // read a BGZF block to $blk; return the block size, 0 on EOF, -1 on errors or -2 at a gzip header that is not BGZF
+{
+	int32_t i, xlen, bsize = 0;
+	size_t l = fread(blk, 1, 12, fp);
+	if (l == 0 && feof(fp)) return 0;
+	if (l != 12 || blk[0] != 31 || blk[1] != 139 || blk[2] != 8) return -1;
+	if ((blk[3]&4) == 0) return -2;
+	xlen = blk[10] | blk[11]<<8;
+	if (12 + xlen + 8 > KS_BGZF_BLK_SIZE) return -1; // $blk holds at most one block
+	if (fread(&blk[12], 1, xlen, fp) != (size_t)xlen) return -1;
+	for (i = 12; i + 4 <= 12 + xlen; i += 4 + (blk[i+2] | blk[i+3]<<8)) // find the BC subfield
+		if (blk[i] == 'B' && blk[i+1] == 'C' && blk[i+2] == 2 && blk[i+3] == 0 && i + 6 <= 12 + xlen)
+			bsize = (blk[i+4] | blk[i+5]<<8) + 1;
+	if (bsize == 0) return -2; // no BC subfield
+	if (bsize < 12 + xlen + 8 || bsize > KS_BGZF_BLK_SIZE) return -1;
+	if (fread(&blk[12 + xlen], 1, bsize - 12 - xlen, fp) != (size_t)(bsize - 12 - xlen)) return -1;
+	return bsize;
+}
+
+static int32_t ks_bgzf_inflate(z_stream *zs, const uint8_t *blk, int32_t bsize, uint8_t *out) // return the decompressed size or -1 on errors
+{
+	int32_t hlen = 12 + (blk[10] | blk[11]<<8);
+	const uint8_t *p = &blk[bsize - 8];
+	uint32_t crc = p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+	uint32_t isize = p[4] | p[5]<<8 | p[6]<<16 | (uint32_t)p[7]<<24;
+	if (isize > KS_BGZF_BLK_SIZE) return -1;
+	inflateReset(zs);
+	zs->next_in = (Bytef*)blk + hlen, zs->avail_in = bsize - hlen - 8;
+	zs->next_out = out, zs->avail_out = KS_BGZF_BLK_SIZE;
+	if (inflate(zs, Z_FINISH) != Z_STREAM_END || zs->total_out != isize) return -1;
+	if (crc32(crc32(0L, Z_NULL, 0), out, isize) != crc) return -1;
+	return isize;
+}
+
+static void ks_bgzf_read_batch(ks_bgzf_t *bz, ks_bgzf_slot_t *s) // read compressed blocks at bz->c_off; called in the critical section to keep batches in order
+{
+	int32_t off = 0;
+	for (s->n_blk = 0; s->n_blk < bz->max_blk;) {
+		int32_t l = ks_bgzf_read_block(bz->fp, &s->cbuf[off]);
+		if (l <= 0) { // blocks read so far are still decompressed
+			bz->eof = 1, bz->err = (l == -1);
+			if (l == -2) bz->tail_off = bz->c_off;
+			pthread_cond_broadcast(&bz->cv);
+			break;
+		}
+		if (s->cbuf[off + l - 4] | s->cbuf[off + l - 3] | s->cbuf[off + l - 2] | s->cbuf[off + l - 1]) { // skip empty blocks such as the EOF marker
+			s->blk_off[s->n_blk] = bz->c_off;
+			s->blk_len[s->n_blk++] = l, off += l;
+		}
+		bz->c_read += l, bz->c_off += l;
+	}
+	s->c_end = bz->c_off;
+	if (bz->max_blk < KS_BGZF_N_BLK) bz->max_blk <<= 1;
+}
+
+static void ks_bgzf_inflate_batch(z_stream *zs, ks_bgzf_slot_t *s) // s->len is set to -1 on errors
+{
+	int32_t i, off;
+	for (i = 0, off = 0, s->len = 0; i < s->n_blk; ++i) {
+		int32_t l = ks_bgzf_inflate(zs, &s->cbuf[off], s->blk_len[i], &s->buf[s->len]);
+		if (l < 0) {
+			s->len = -1;
+			break;
+		}
+		s->blk_ulen[i] = l, s->len += l, off += s->blk_len[i];
+	}
+}
+
+static void *ks_bgzf_worker(void *data)
+{
+	ks_bgzf_t *bz = (ks_bgzf_t*)data;
+	z_stream zs;
+	memset(&zs, 0, sizeof(zs));
+	inflateInit2(&zs, -15);
+	for (;;) {
+		ks_bgzf_slot_t *s;
+		pthread_mutex_lock(&bz->lock);
+		while (!bz->stop && (bz->eof || bz->slot[bz->seq_next % bz->n_slot].state != 0)) // workers stay at the end of file in case of ks_bgzf_seek()
+			pthread_cond_wait(&bz->cv, &bz->lock);
+		if (bz->stop) {
+			pthread_mutex_unlock(&bz->lock);
+			break;
+		}
+		s = &bz->slot[bz->seq_next++ % bz->n_slot];
+		s->state = 1;
+		ks_bgzf_read_batch(bz, s);
+		pthread_mutex_unlock(&bz->lock);
+		ks_bgzf_inflate_batch(&zs, s);
+		pthread_mutex_lock(&bz->lock);
+		s->state = 2;
+		pthread_cond_broadcast(&bz->cv);
+		pthread_mutex_unlock(&bz->lock);
+	}
+	inflateEnd(&zs);
+	return 0;
+}
+
+static ks_bgzf_t *ks_bgzf_init(FILE *fp, int32_t n_threads)
+{
+	ks_bgzf_t *bz = K8_CALLOC(ks_bgzf_t, 1);
+	bz->fp = fp, bz->n_threads = n_threads, bz->n_slot = n_threads * 2 + 2, bz->max_blk = KS_BGZF_N_BLK, bz->tail_off = -1;
+	bz->slot = K8_CALLOC(ks_bgzf_slot_t, bz->n_slot);
+	for (int32_t i = 0; i < bz->n_slot; ++i) {
+		bz->slot[i].cbuf = K8_MALLOC(uint8_t, KS_BGZF_BLK_SIZE * KS_BGZF_N_BLK);
+		bz->slot[i].buf = K8_MALLOC(uint8_t, KS_BGZF_BLK_SIZE * KS_BGZF_N_BLK);
+	}
+	pthread_mutex_init(&bz->lock, 0);
+	pthread_cond_init(&bz->cv, 0);
+	if (n_threads == 0) inflateInit2(&bz->zs, -15);
+	bz->tid = K8_CALLOC(pthread_t, n_threads);
+	for (int32_t i = 0; i < n_threads; ++i)
+		pthread_create(&bz->tid[i], 0, ks_bgzf_worker, bz);
+	return bz;
+}
+
+static void ks_bgzf_destroy(ks_bgzf_t *bz)
+{
+	pthread_mutex_lock(&bz->lock);
+	bz->stop = 1;
+	pthread_cond_broadcast(&bz->cv);
+	pthread_mutex_unlock(&bz->lock);
+	for (int32_t i = 0; i < bz->n_threads; ++i)
+		pthread_join(bz->tid[i], 0);
+	if (bz->n_threads == 0) inflateEnd(&bz->zs);
+	pthread_mutex_destroy(&bz->lock);
+	pthread_cond_destroy(&bz->cv);
+	for (int32_t i = 0; i < bz->n_slot; ++i) {
+		free(bz->slot[i].cbuf); free(bz->slot[i].buf);
+	}
+	free(bz->slot); free(bz->tid);
+	fclose(bz->fp);
+	free(bz);
+}
+
+static int32_t ks_bgzf_next(ks_bgzf_t *bz, uint8_t **buf) // similar to ks_pf_next(), except that -2 is returned at bz->tail_off
+{
+	int32_t len = 0;
+	ks_bgzf_slot_t *s;
+	pthread_mutex_lock(&bz->lock);
+	s = &bz->slot[bz->seq_read % bz->n_slot];
+	if (bz->holding && s->len > 0) { // give the previous batch back to the workers
+		s->state = 0, bz->holding = 0;
+		s = &bz->slot[++bz->seq_read % bz->n_slot];
+		pthread_cond_broadcast(&bz->cv);
+	}
+	if (bz->n_threads == 0 && s->state == 0 && !bz->eof) { // decompress here
+		++bz->seq_next;
+		ks_bgzf_read_batch(bz, s);
+		ks_bgzf_inflate_batch(&bz->zs, s);
+		s->state = 2;
+	}
+	while (s->state != 2 && !(bz->eof && bz->seq_read == bz->seq_next)) // no worker will fill this batch at the end of file
+		pthread_cond_wait(&bz->cv, &bz->lock);
+	if (s->state == 2 && s->len != 0) {
+		bz->holding = 1;
+		*buf = s->buf, len = s->len;
+	} else len = bz->err? -1 : bz->tail_off >= 0? -2 : 0; // a batch that failed to inflate is returned above and kept, so -2 follows clean batches only
+	pthread_mutex_unlock(&bz->lock);
+	return len;
+}
+
+static int32_t ks_bgzf_seek(ks_bgzf_t *bz, int64_t c_off) // restart reading at the block at $c_off; return 0 on success or -1 on errors
+{
+	int32_t i, ret;
+	pthread_mutex_lock(&bz->lock);
+	for (;;) { // wait for batches being decompressed
+		for (i = 0; i < bz->n_slot; ++i)
+			if (bz->slot[i].state == 1) break;
+		if (i == bz->n_slot) break;
+		pthread_cond_wait(&bz->cv, &bz->lock);
+	}
+	for (i = 0; i < bz->n_slot; ++i)
+		bz->slot[i].state = 0, bz->slot[i].len = 0;
+	bz->seq_read = bz->seq_next = 0, bz->holding = 0, bz->max_blk = 1;
+	ret = fseeko(bz->fp, c_off, SEEK_SET);
+	bz->eof = bz->err = (ret < 0), bz->c_off = c_off, bz->tail_off = -1;
+	pthread_cond_broadcast(&bz->cv);
+	pthread_mutex_unlock(&bz->lock);
+	return ret < 0? -1 : 0;
+}
+
+static int64_t ks_bgzf_tell(ks_bgzf_t *bz, int32_t st) // virtual offset of byte $st in the current batch
+{
+	int64_t voff;
+	int32_t i;
+	pthread_mutex_lock(&bz->lock);
+	ks_bgzf_slot_t *s = &bz->slot[bz->seq_read % bz->n_slot];
+	if (bz->holding) {
+		for (i = 0; i < s->n_blk && st >= s->blk_ulen[i]; ++i)
+			st -= s->blk_ulen[i];
+		voff = i < s->n_blk? s->blk_off[i] << 16 | st : s->c_end << 16;
+	} else if (bz->seq_read < bz->seq_next) { // the next batch has been read from the file
+		voff = (s->n_blk > 0? s->blk_off[0] : s->c_end) << 16;
+	} else voff = bz->c_off << 16;
+	pthread_mutex_unlock(&bz->lock);
+	return voff;
+}
+
+static int32_t ks_bgzf_deflate(z_stream *zs, const uint8_t *in, int32_t l_in, uint8_t *blk) // compress a BGZF block; return the block size or -1 on errors
+{
+	static const uint8_t hdr[16] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0 };
+	uint32_t crc = crc32(crc32(0L, Z_NULL, 0), in, l_in);
+	int32_t bsize;
+	deflateReset(zs);
+	zs->next_in = (Bytef*)in, zs->avail_in = l_in;
+	zs->next_out = blk + 18, zs->avail_out = KS_BGZF_BLK_SIZE - 18 - 8;
+	if (deflate(zs, Z_FINISH) != Z_STREAM_END) return -1;
+	bsize = 18 + zs->total_out + 8;
+	memcpy(blk, hdr, 16);
+	blk[16] = (bsize - 1) & 0xff, blk[17] = (bsize - 1) >> 8;
+	for (int32_t i = 0; i < 4; ++i)
+		blk[bsize - 8 + i] = crc >> (i * 8) & 0xff, blk[bsize - 4 + i] = (uint32_t)l_in >> (i * 8) & 0xff;
+	return bsize;
+}
+
+static int32_t ks_zw_deflate_init(const ks_zw_t *zw, z_stream *zs)
+{
+	memset(zs, 0, sizeof(*zs));
+	return deflateInit2(zs, zw->level, Z_DEFLATED, zw->is_bgzf? -15 : 15 + 16, 8, Z_DEFAULT_STRATEGY); // raw deflate for BGZF and a gzip member otherwise
+}
+
+static void ks_zw_compress(const ks_zw_t *zw, z_stream *zs, ks_zw_slot_t *s)
+{
+	s->l_out = 0;
+	if (zw->is_bgzf) {
+		for (int32_t off = 0; off < s->l_in; off += KS_BGZF_IN_SIZE) {
+			int32_t l = ks_bgzf_deflate(zs, &s->in[off], s->l_in - off < KS_BGZF_IN_SIZE? s->l_in - off : KS_BGZF_IN_SIZE, &s->out[s->l_out]);
+			if (l < 0) {
+				s->l_out = -1;
+				break;
+			}
+			s->l_out += l;
+		}
+	} else {
+		deflateReset(zs);
+		zs->next_in = s->in, zs->avail_in = s->l_in;
+		zs->next_out = s->out, zs->avail_out = zw->m_out;
+		s->l_out = deflate(zs, Z_FINISH) == Z_STREAM_END? zs->total_out : -1;
+	}
+}
+
+static void *ks_zw_worker(void *data)
+{
+	ks_zw_t *zw = (ks_zw_t*)data;
+	z_stream zs;
+	ks_zw_deflate_init(zw, &zs);
+	for (;;) {
+		ks_zw_slot_t *s;
+		pthread_mutex_lock(&zw->lock);
+		while (!zw->stop && zw->slot[zw->seq_comp % zw->n_slot].state != 1)
+			pthread_cond_wait(&zw->cv, &zw->lock);
+		if (zw->stop) {
+			pthread_mutex_unlock(&zw->lock);
+			break;
+		}
+		s = &zw->slot[zw->seq_comp++ % zw->n_slot];
+		s->state = 2;
+		pthread_mutex_unlock(&zw->lock);
+		ks_zw_compress(zw, &zs, s);
+		pthread_mutex_lock(&zw->lock);
+		s->state = 3;
+		pthread_cond_broadcast(&zw->cv);
+		pthread_mutex_unlock(&zw->lock);
+	}
+	deflateEnd(&zs);
+	return 0;
+}
+
+static ks_zw_t *ks_zw_init(FILE *fp, int32_t is_bgzf, int32_t level, int32_t n_threads)
+{
+	ks_zw_t *zw = K8_CALLOC(ks_zw_t, 1);
+	zw->fp = fp, zw->is_bgzf = is_bgzf, zw->level = level, zw->n_threads = n_threads;
+	zw->n_slot = n_threads > 0? n_threads * 2 + 2 : 1;
+	zw->m_out = is_bgzf? KS_BGZF_BLK_SIZE * KS_BGZF_N_BLK : compressBound(KS_ZW_JOB_SIZE) + 32; // 32 for the gzip header and footer
+	zw->slot = K8_CALLOC(ks_zw_slot_t, zw->n_slot);
+	for (int32_t i = 0; i < zw->n_slot; ++i) {
+		zw->slot[i].in = K8_MALLOC(uint8_t, KS_ZW_JOB_SIZE);
+		zw->slot[i].out = K8_MALLOC(uint8_t, zw->m_out);
+	}
+	if (n_threads == 0) ks_zw_deflate_init(zw, &zw->zs);
+	pthread_mutex_init(&zw->lock, 0);
+	pthread_cond_init(&zw->cv, 0);
+	zw->tid = K8_CALLOC(pthread_t, n_threads);
+	for (int32_t i = 0; i < n_threads; ++i)
+		pthread_create(&zw->tid[i], 0, ks_zw_worker, zw);
+	return zw;
+}
+
+static void ks_zw_write_next(ks_zw_t *zw) // write the oldest job, waiting for it to be compressed
+{
+	ks_zw_slot_t *s = &zw->slot[zw->seq_write % zw->n_slot];
+	pthread_mutex_lock(&zw->lock);
+	while (s->state != 3)
+		pthread_cond_wait(&zw->cv, &zw->lock);
+	pthread_mutex_unlock(&zw->lock);
+	if (s->l_out < 0 || (s->l_out > 0 && fwrite(s->out, 1, s->l_out, zw->fp) != (size_t)s->l_out))
+		zw->err = 1;
+	else zw->c_written += s->l_out;
+	pthread_mutex_lock(&zw->lock);
+	s->state = 0, s->l_in = 0;
+	++zw->seq_write;
+	pthread_mutex_unlock(&zw->lock);
+}
+
+static void ks_zw_submit(ks_zw_t *zw) // send the job being filled to compression
+{
+	ks_zw_slot_t *s = &zw->slot[zw->seq_fill % zw->n_slot];
+	if (s->l_in == 0) return;
+	if (zw->n_threads == 0) {
+		ks_zw_compress(zw, &zw->zs, s);
+		s->state = 3;
+	}
+	pthread_mutex_lock(&zw->lock);
+	if (zw->n_threads > 0) s->state = 1;
+	++zw->seq_fill;
+	pthread_cond_broadcast(&zw->cv);
+	pthread_mutex_unlock(&zw->lock);
+}
+
+static int64_t ks_zw_write(ks_zw_t *zw, const uint8_t *data, int64_t len)
+{
+	int64_t off = 0;
+	while (off < len) {
+		ks_zw_slot_t *s = &zw->slot[zw->seq_fill % zw->n_slot];
+		while (zw->seq_write + zw->n_slot <= zw->seq_fill) // the slot is still occupied by an earlier job
+			ks_zw_write_next(zw);
+		int64_t l = KS_ZW_JOB_SIZE - s->l_in < len - off? KS_ZW_JOB_SIZE - s->l_in : len - off;
+		memcpy(&s->in[s->l_in], &data[off], l);
+		s->l_in += l, off += l;
+		if (s->l_in == KS_ZW_JOB_SIZE) ks_zw_submit(zw);
+	}
+	return zw->err? -1 : len;
+}
+
+static int32_t ks_zw_flush(ks_zw_t *zw) // compress and write all pending data; return 0 on success or -1 on errors
+{
+	if (zw->seq_write + zw->n_slot > zw->seq_fill) // if the last slot is not occupied, there may be data being filled
+		ks_zw_submit(zw);
+	while (zw->seq_write < zw->seq_fill)
+		ks_zw_write_next(zw);
+	return zw->err? -1 : 0;
+}
+
+static int32_t ks_zw_finish(ks_zw_t *zw) // write all pending data and the BGZF EOF marker; nothing can be written afterwards
+{
+	static const uint8_t bgzf_eof[28] = { 31, 139, 8, 4, 0, 0, 0, 0, 0, 255, 6, 0, 'B', 'C', 2, 0, 27, 0, 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+	if (zw->finished) return zw->err? -1 : 0;
+	ks_zw_flush(zw);
+	if (zw->is_bgzf) {
+		if (fwrite(bgzf_eof, 1, 28, zw->fp) != 28) zw->err = 1;
+		else zw->c_written += 28;
+	}
+	zw->finished = 1;
+	return zw->err? -1 : 0;
+}
+
+static void ks_zw_destroy(ks_zw_t *zw)
+{
+	ks_zw_finish(zw);
+	pthread_mutex_lock(&zw->lock);
+	zw->stop = 1;
+	pthread_cond_broadcast(&zw->cv);
+	pthread_mutex_unlock(&zw->lock);
+	for (int32_t i = 0; i < zw->n_threads; ++i)
+		pthread_join(zw->tid[i], 0);
+	if (zw->n_threads == 0) deflateEnd(&zw->zs);
+	pthread_mutex_destroy(&zw->lock);
+	pthread_cond_destroy(&zw->cv);
+	for (int32_t i = 0; i < zw->n_slot; ++i) {
+		free(zw->slot[i].in); free(zw->slot[i].out);
+	}
+	free(zw->slot); free(zw->tid);
+	free(zw);
+}
+
+#define KS_MM_CHUNK 0x40000000 // ks->buf walks through a memory mapped file in chunks as ks->en is 32-bit
+
+static uint8_t *ks_mmap(const char *fn, int64_t *len, int32_t writable) // map an uncompressed regular file; return NULL if not possible
+{
+	struct stat st;
+	uint8_t *mm;
+	int fd = open(fn, O_RDONLY);
+	*len = 0;
+	if (fd < 0) return 0;
+	if (fstat(fd, &st) < 0 || !S_ISREG(st.st_mode) || st.st_size < 2) {
+		close(fd);
+		return 0;
+	}
+	mm = (uint8_t*)mmap(0, st.st_size, writable? PROT_READ|PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, 0); // MAP_PRIVATE: writes are not carried to the file
+	close(fd);
+	if (mm == MAP_FAILED) return 0;
+	if (mm[0] == 0x1f && mm[1] == 0x8b) { // gzip magic
+		munmap(mm, st.st_size);
+		return 0;
+	}
+	*len = st.st_size;
+	return mm;
+}
+
+typedef struct {
+	char *fn;
+	ks_stat_t stat;
+} ks_stat_rec_t;
+
+static pthread_mutex_t ks_live_lock = PTHREAD_MUTEX_INITIALIZER; // files may be opened and closed by workers
+static int32_t ks_n_live, ks_m_live, ks_stat_n_done, ks_stat_m_done;
+static k8_file_t **ks_live; // files not closed yet in all threads, including the stdout/stderr buffers
+static ks_stat_rec_t *ks_stat_done; // statistics of closed files
+
+static void ks_stat_sync(k8_file_t *ks) // update the compressed byte counts
+{
+	if (ks->mm) ks->stat.z_in = ks->stat.n_in;
+	else if (ks->bz) {
+		pthread_mutex_lock(&ks->bz->lock);
+		ks->stat.z_in = ks->bz->c_read;
+		pthread_mutex_unlock(&ks->bz->lock);
+	} else if (ks->pf) {
+		pthread_mutex_lock(&ks->pf->lock);
+		ks->stat.z_in = ks->pf->c_off;
+		pthread_mutex_unlock(&ks->pf->lock);
+	} else if (ks->fp) ks->stat.z_in = gzoffset(ks->fp);
+	ks->stat.z_out = ks->zw? ks->zw->c_written : ks->stat.n_out;
+}
+
+static void ks_track(k8_file_t *ks, int32_t is_open) // keep track of open files; with --stats, save the statistics of closed ones
+{
+	int32_t i;
+	pthread_mutex_lock(&ks_live_lock);
+	if (is_open) {
+		K8_GROW(k8_file_t*, ks_live, ks_n_live, ks_m_live);
+		ks_live[ks_n_live++] = ks;
+	} else {
+		for (i = 0; i < ks_n_live; ++i)
+			if (ks_live[i] == ks) break;
+		if (i < ks_n_live) {
+			ks_live[i] = ks_live[--ks_n_live];
+			if (k8_stats_on) {
+				ks_stat_sync(ks);
+				K8_GROW(ks_stat_rec_t, ks_stat_done, ks_stat_n_done, ks_stat_m_done);
+				ks_stat_done[ks_stat_n_done].fn = ks->fn, ks->fn = 0;
+				ks_stat_done[ks_stat_n_done++].stat = ks->stat;
+			}
+		}
+	}
+	pthread_mutex_unlock(&ks_live_lock);
+}
+
+static k8_file_t *ks_open(int fd, const char *fn, const char *mode, int32_t n_threads, int32_t level)
+{
+	gzFile fp = 0;
+	FILE *fpw = 0, *fpb = 0;
+	uint8_t *mm = 0;
+	int64_t mm_len = 0;
+	int32_t write_file = (mode && (strchr(mode, 'w') || strchr(mode, 'a')) && strchr(mode, 'r') == 0);
+	int32_t zfmt = 0; // 1 for gzip and 2 for BGZF
+	char wmode[2] = { 'w', 0 };
+	if (write_file) { // parse "wz", "wb" and the compression level such as in "wz1"
+		if (strchr(mode, 'a')) wmode[0] = 'a';
+		for (const char *p = mode; *p; ++p)
+			if (*p == 'z') zfmt = 1;
+			else if (*p == 'b') zfmt = 2;
+			else if (*p >= '0' && *p <= '9' && level < 0) level = *p - '0';
+	}
+	if (fd >= 0) {
+		if (write_file) fpw = fdopen(fd, wmode);
+		else fp = gzdopen(fd, "r");
+	} else if (fn) {
+		if (write_file) fpw = strcmp(fn, "-")? fopen(fn, wmode) : stdout;
+		else if (strcmp(fn, "-") == 0) fp = gzdopen(0, "r");
+		else if ((mm = ks_mmap(fn, &mm_len, 0)) != 0) madvise(mm, mm_len, MADV_SEQUENTIAL);
+		else if ((fpb = ks_bgzf_check(fn)) == 0) fp = gzopen(fn, "r"); // BGZF is read block by block for virtual offsets
+	} else {
+		if (write_file) fpw = stdout;
+		else fp = gzdopen(0, "r");
+	}
+	if (fp == 0 && fpw == 0 && fpb == 0 && mm == 0) return 0;
+	k8_file_t *ks = K8_CALLOC(k8_file_t, 1);
+	ks->magic = K8_FILE_MAGIC, ks->tid = pthread_self();
+	ks->fp = fp, ks->fpw = fpw;
+	if (fn) ks->fn = strdup(fn);
+	else {
+		char buf[32];
+		snprintf(buf, 32, "fd:%d", fd);
+		ks->fn = strdup(fd >= 0? buf : "-");
+	}
+	if (fp || fpb || mm) {
+		ks->buf_size = 0x40000;
+		if (mm) ks->mm = mm, ks->mm_len = mm_len; // ks->buf points to the mapped file or to the buffers of threads
+		else if (fpb) ks->bz = ks_bgzf_init(fpb, n_threads > 0? n_threads : 0);
+		else if (n_threads > 0) ks->pf = ks_pf_init(fp, ks->buf_size);
+		else ks->buf = K8_CALLOC(uint8_t, ks->buf_size);
+	} else {
+		if (zfmt) ks->zw = ks_zw_init(fpw, zfmt == 2, level < 0? Z_DEFAULT_COMPRESSION : level > 9? 9 : level, n_threads);
+		ks->out_size = KS_OUT_SIZE;
+		ks->out_sync = (ks->zw == 0 && isatty(fileno(fpw))); // behave like line buffering on terminals
+	}
+	ks_track(ks, 1);
+	return ks;
+}
+
+static int64_t ks_write_raw(k8_file_t *ks, const uint8_t *data, int64_t len)
+{
+	double t = k8_realtime();
+	int64_t ret;
+	if (ks->zw) ret = ks_zw_write(ks->zw, data, len);
+	else ret = len > 0 && fwrite(data, 1, len, ks->fpw) != (size_t)len? -1 : len;
+	ks->stat.t_flush += k8_realtime() - t;
+	++ks->stat.n_flush;
+	if (ret > 0) ks->stat.n_out += ret;
+	return ret;
+}
+
+static int32_t ks_flush(k8_file_t *ks) // write out the output buffer; return 0 on success or -1 on errors
+{
+	int64_t ret = 0;
+	if (ks->out.l > 0) ret = ks_write_raw(ks, ks->out.s, ks->out.l);
+	ks->out.l = 0;
+	if (ret >= 0 && ks->zw == 0 && ks->out_sync) ret = fflush(ks->fpw);
+	return ret < 0? -1 : 0;
+}
+
+static int32_t ks_flush_all(k8_file_t *ks) // also flush the compressor and stdio
+{
+	int32_t ret = ks_flush(ks);
+	double t = k8_realtime();
+	if (ks->zw && ks_zw_flush(ks->zw) < 0) ret = -1;
+	if (fflush(ks->fpw) != 0) ret = -1;
+	ks->stat.t_flush += k8_realtime() - t;
+	return ret;
+}
+
+static inline uint8_t *ks_reserve(k8_file_t *ks, int64_t len) // make room for $len bytes; the caller writes to the returned pointer and updates ks->out.l
+{
+	if (ks->out.l + len > ks->out_size && ks->out.l > 0) ks_flush(ks);
+	if (ks->out.l + len > ks->out.m) {
+		ks->out.m = ks->out.l + len > ks->out_size? ks->out.l + len : ks->out_size;
+		ks->out.s = K8_REALLOC(uint8_t, ks->out.s, ks->out.m);
+	}
+	return ks->out.s + ks->out.l;
+}
+
+static int64_t ks_write(k8_file_t *ks, const uint8_t *data, int64_t len)
+{
+	if (len >= ks->out_size) { // too large to buffer
+		if (ks_flush(ks) < 0) return -1;
+		return ks_write_raw(ks, data, len);
+	}
+	memcpy(ks_reserve(ks, len), data, len);
+	ks->out.l += len;
+	return len;
+}
+
+static inline void ks_putc(k8_file_t *ks, int c)
+{
+	*ks_reserve(ks, 1) = c;
+	++ks->out.l;
+}
+
+static void ks_write_int(k8_file_t *ks, int64_t x)
+{
+	uint8_t buf[24];
+	int32_t i = 24;
+	uint64_t u = x < 0? -(uint64_t)x : x;
+	do buf[--i] = '0' + u % 10; while (u /= 10);
+	if (x < 0) buf[--i] = '-';
+	memcpy(ks_reserve(ks, 24 - i), &buf[i], 24 - i);
+	ks->out.l += 24 - i;
+}
+
+static k8_file_t *ks_std(int32_t i) // 0 for stdout and 1 for stderr
+{
+	if (ks_std_buf[i] == 0) {
+		ks_std_buf[i] = ks_open(-1, "-", "w", 0, -1);
+		if (i == 1) {
+			ks_std_buf[i]->fpw = stderr, ks_std_buf[i]->out_sync = 1;
+			free(ks_std_buf[i]->fn);
+			ks_std_buf[i]->fn = strdup("(stderr)");
+		}
+	}
+	return ks_std_buf[i];
+}
+
+static void ks_std_destroy(void) // flush and free the stdout/stderr buffers of the current thread
+{
+	for (int32_t i = 0; i < 2; ++i) {
+		if (ks_std_buf[i] == 0) continue;
+		ks_flush(ks_std_buf[i]);
+		fflush(ks_std_buf[i]->fpw);
+		ks_track(ks_std_buf[i], 0);
+		free(ks_std_buf[i]->out.s);
+		free(ks_std_buf[i]->fn);
+		free(ks_std_buf[i]);
+		ks_std_buf[i] = 0;
+	}
+}
+
+static void ks_close(k8_file_t *ks)
+{
+	if (ks == 0) return;
+	if (ks->fpw) ks_flush(ks);
+	if (ks->fpw == stdout && ks_std_buf[0]) ks_flush(ks_std_buf[0]);
+	if (ks->zw) ks_zw_finish(ks->zw); // before ks_track() so that the compressed size is complete
+	ks_track(ks, 0);
+	free(ks->out.s);
+	free(ks->fn);
+	if (ks->mm) munmap(ks->mm, ks->mm_len);
+	else if (ks->bz) ks_bgzf_destroy(ks->bz);
+	else if (ks->pf) ks_pf_destroy(ks->pf);
+	else free(ks->buf);
+	if (ks->zw) ks_zw_destroy(ks->zw);
+	if (ks->fp) gzclose(ks->fp);
+	free(ks->gzi);
+	if (ks->fpw) fclose(ks->fpw);
+	memset(ks, 0, sizeof(*ks));
+	free(ks);
+}
+
+static void ks_flush_live(void) // write out the buffered output of files opened by this thread when its script ends; files of other threads may be in use
+{
+	pthread_mutex_lock(&ks_live_lock);
+	for (int32_t i = 0; i < ks_n_live; ++i) {
+		k8_file_t *ks = ks_live[i];
+		if (ks->fpw == 0 || !pthread_equal(ks->tid, pthread_self())) continue;
+		ks_flush(ks);
+		if (ks->zw) ks_zw_finish(ks->zw); // write pending jobs and the BGZF EOF marker
+		fflush(ks->fpw);
+	}
+	pthread_mutex_unlock(&ks_live_lock);
+}
+
+static int64_t ks_mem(const k8_file_t *ks) // approximate memory held by $ks; memory mapped files are not counted
+{
+	int64_t m = 0;
+	if (ks->pf) m += (int64_t)ks->buf_size * KS_PF_N_BUF;
+	else if (ks->bz) m += (int64_t)ks->bz->n_slot * KS_BGZF_BLK_SIZE * KS_BGZF_N_BLK * 2;
+	else if (ks->mm == 0) m += ks->buf_size;
+	if (ks->fpw) m += ks->out_size;
+	if (ks->zw) m += (int64_t)ks->zw->n_slot * (KS_ZW_JOB_SIZE + ks->zw->m_out);
+	return m;
+}
+
+static int32_t ks_bgzf_tail(k8_file_t *ks) // switch from the BGZF reader to gzread() at bz->tail_off; return 0 on success or -1 on errors
+{
+	ks_bgzf_t *bz = ks->bz;
+	int fd = dup(fileno(bz->fp));
+	if (fd < 0) return -1;
+	if (lseek(fd, bz->tail_off, SEEK_SET) < 0 || (ks->fp = gzdopen(fd, "r")) == 0) {
+		close(fd);
+		return -1;
+	}
+	if (bz->n_threads > 0) ks->pf = ks_pf_init(ks->fp, ks->buf_size);
+	else ks->buf = K8_CALLOC(uint8_t, ks->buf_size);
+	ks_bgzf_destroy(bz);
+	ks->bz = 0, ks->bz_tail = 1;
+	return 0;
+}
+
+static inline int32_t ks_fill(k8_file_t *ks) // refill ks->buf; return the number of bytes read, 0 on EOF or -1 on errors
+{
+	ks->st = 0;
+	if (ks->en > 0) ks->u_pos += ks->en;
+	if (ks->mm) {
+		ks->buf = ks->mm + ks->mm_off;
+		ks->en = ks->mm_len - ks->mm_off < KS_MM_CHUNK? ks->mm_len - ks->mm_off : KS_MM_CHUNK;
+		ks->mm_off += ks->en;
+	} else {
+		double t = k8_realtime();
+		if (ks->bz) ks->en = ks_bgzf_next(ks->bz, &ks->buf);
+		if (ks->bz && ks->en == -2 && ks_bgzf_tail(ks) < 0) ks->en = -1;
+		if (ks->bz == 0) {
+			if (ks->pf) ks->en = ks_pf_next(ks->pf, &ks->buf);
+			else ks->en = gzread(ks->fp, ks->buf, ks->buf_size);
+		}
+		ks->stat.t_fill += k8_realtime() - t;
+	}
+	++ks->stat.n_fill;
+	if (ks->en > 0) ks->stat.n_in += ks->en;
+	return ks->en;
+}
+
+static inline int32_t ks_getc(k8_file_t *ks)
+{
+	if (ks_err(ks)) return -3;
+	if (ks_eof(ks)) return -1;
+	if (ks->st >= ks->en) {
+		ks_fill(ks);
+		if (ks->en == 0) { ks->is_eof = 1; return -1; }
+		else if (ks->en < 0) { ks->is_eof = 1; return -3; }
+	}
+	return (int32_t)ks->buf[ks->st++];
+}
+
+static int64_t ks_read(k8_file_t *ks, uint8_t *buf, int64_t len)
+{
+	int64_t off = 0;
+	if (ks->is_eof && ks->st >= ks->en) return 0;
+	while (len > ks->en - ks->st) {
+		int64_t l = ks->en - ks->st;
+		if (l > 0) {
+			memcpy(buf + off, ks->buf + ks->st, l);
+			len -= l; off += l;
+		}
+		ks_fill(ks);
+		if (ks->en <= 0) ks->is_eof = 1; // not testing a short read as batches of BGZF blocks vary in size
+		if (ks->en == 0) return off;
+		else if (ks->en < 0) return -3; // gzread error
+	}
+	memcpy(buf + off, ks->buf + ks->st, len);
+	ks->st += len;
+	return off + len;
+}
+
+static inline int64_t ks_remain(const k8_file_t *ks) // number of bytes left if known in advance; -1 otherwise
+{
+	return ks->mm? ks->mm_len - ks->mm_off + (ks->en - ks->st) : -1;
+}
+
+static int64_t ks_read_all_at(k8_file_t *ks, kstring_t *str, int64_t off) // read the rest to str->s[off..]; return the number of bytes read
+{
+	int64_t rem = ks_remain(ks);
+	str->l = off;
+	if (rem >= 0) K8_GROW(uint8_t, str->s, off + rem, str->m); // exact size for mapped files; grow geometrically otherwise
+	if (ks->mm && rem > 0) { // copy from the mapping and drop copied pages to keep the peak RSS at about the file size
+		const int64_t step = 1<<24, mask = sysconf(_SC_PAGESIZE) - 1;
+		int64_t st = ks->mm_len - rem, a = (st + mask) & ~mask, i;
+		for (i = st; i < ks->mm_len; i += step) {
+			int64_t l = ks->mm_len - i < step? ks->mm_len - i : step, b = (i + l) & ~mask;
+			memcpy(&str->s[str->l], &ks->mm[i], l);
+			str->l += l;
+			if (b > a) madvise(ks->mm + a, b - a, MADV_DONTNEED), a = b;
+		}
+		++ks->stat.n_fill, ks->stat.n_in += ks->mm_len - ks->mm_off;
+		ks->mm_off = ks->u_pos = ks->mm_len, ks->st = ks->en = 0, ks->is_eof = 1;
+	}
+	while (!ks_eof(ks)) {
+		int64_t l = ks->en - ks->st;
+		if (l > 0) {
+			K8_GROW(uint8_t, str->s, str->l + l, str->m);
+			memcpy(&str->s[str->l], &ks->buf[ks->st], l);
+			str->l += l;
+		}
+		ks_fill(ks);
+		if (ks->en <= 0) {
+			ks->is_eof = 1;
+			break;
+		}
+	}
+	K8_GROW(uint8_t, str->s, str->l, str->m); // allocate for an empty file
+	str->s[str->l] = 0;
+	return str->l - off;
+}
+
+static inline int64_t ks_read_all(k8_file_t *ks, kstring_t *str) { return ks_read_all_at(ks, str, 0); }
+
+static int64_t ks_tell(k8_file_t *ks) // virtual offset for BGZF and uncompressed offset otherwise; -2 for files being written or with a non-BGZF tail
+{
+	if (ks->fpw || ks->bz_tail) return -2;
+	if (ks->bz) return ks_bgzf_tell(ks->bz, ks->st);
+	return ks->u_pos + ks->st;
+}
+
+static int64_t ks_skip(k8_file_t *ks, int64_t n) // skip $n bytes; return the number of bytes skipped
+{
+	int64_t k = 0;
+	while (k < n) {
+		if (ks->st >= ks->en && ks_fill(ks) <= 0) {
+			ks->is_eof = 1;
+			break;
+		}
+		int64_t l = ks->en - ks->st < n - k? ks->en - ks->st : n - k;
+		ks->st += l, k += l;
+	}
+	return k;
+}
+
+static int32_t ks_seek(k8_file_t *ks, int64_t off) // $off is as from ks_tell(); return 0 on success, -2 for bad arguments or -3 on stream errors
+{
+	if (ks->fpw || ks->bz_tail || off < 0) return -2;
+	ks->st = ks->en = 0, ks->is_eof = 0, ks->last_char = 0;
+	if (ks->bz) {
+		int32_t u = off & 0xffff;
+		if (ks_bgzf_seek(ks->bz, off >> 16) < 0) return -3;
+		return ks_skip(ks, u) < u? -3 : 0; // the first block of the batch is the one at off>>16
+	}
+	if (ks->mm) {
+		ks->mm_off = ks->u_pos = off < ks->mm_len? off : ks->mm_len;
+		return 0;
+	}
+	if (ks->pf) ks_pf_destroy(ks->pf), ks->buf = 0; // the prefetcher is restarted at the new offset
+	int64_t ret = gzseek(ks->fp, off, SEEK_SET); // emulated by decompressing from the start for gzip
+	if (ks->pf) ks->pf = ks_pf_init(ks->fp, ks->buf_size);
+	ks->u_pos = ret < 0? 0 : ret;
+	return ret < 0? -3 : 0;
+}
+
+static inline uint32_t ks_get_le32(const uint8_t *p)
+{
+	return p[0] | p[1]<<8 | p[2]<<16 | (uint32_t)p[3]<<24;
+}
+
+static inline uint64_t ks_get_le64(const uint8_t *p)
+{
+	uint64_t x = 0;
+	for (int32_t i = 7; i >= 0; --i) x = x << 8 | p[i];
+	return x;
+}
+
+static inline void ks_put_le64(uint8_t *p, uint64_t x)
+{
+	for (int32_t i = 0; i < 8; ++i, x >>= 8) p[i] = x & 0xff;
+}
+
+static int64_t *ks_gzi_build(const char *fn, int64_t *n) // scan BGZF blocks for the compressed and uncompressed offsets of non-empty blocks
+{
+	FILE *fp = fopen(fn, "rb");
+	int64_t c = 0, u = 0, m = 0, *a = 0;
+	int32_t l = -1;
+	*n = -1;
+	if (fp == 0) return 0;
+	uint8_t *blk = K8_MALLOC(uint8_t, KS_BGZF_BLK_SIZE);
+	*n = 0;
+	while ((l = ks_bgzf_read_block(fp, blk)) > 0) {
+		uint32_t isize = blk[l-4] | blk[l-3]<<8 | blk[l-2]<<16 | (uint32_t)blk[l-1]<<24;
+		if (isize > 0) {
+			K8_GROW(int64_t, a, *n * 2 + 1, m);
+			a[*n * 2] = c, a[*n * 2 + 1] = u, ++*n;
+		}
+		c += l, u += isize;
+	}
+	free(blk);
+	fclose(fp);
+	if (l < 0) {
+		free(a);
+		*n = -1;
+		return 0;
+	}
+	return a;
+}
+
+static int64_t *ks_gzi_load(const char *fn, int64_t *n) // read a .gzi as is written by "bgzip -i"; the first block at (0,0) is implicit in the file
+{
+	FILE *fp = fopen(fn, "rb");
+	struct stat st;
+	uint8_t b[16];
+	int64_t i, k, *a = 0;
+	*n = -1;
+	if (fp == 0) return 0;
+	if (fstat(fileno(fp), &st) == 0 && fread(b, 1, 8, fp) == 8) {
+		k = ks_get_le64(b);
+		if (k < 0 || k > (st.st_size - 8) / 16 || 8 + 16 * k != st.st_size) { // the count must agree with the file size
+			fclose(fp);
+			return 0;
+		}
+		if ((a = K8_MALLOC(int64_t, (k + 1) * 2)) == 0) {
+			fclose(fp);
+			return 0;
+		}
+		a[0] = a[1] = 0;
+		for (i = 1; i <= k && fread(b, 1, 16, fp) == 16; ++i)
+			a[i * 2] = ks_get_le64(b), a[i * 2 + 1] = ks_get_le64(b + 8);
+		if (i == k + 1) *n = k + 1;
+		else free(a), a = 0;
+	}
+	fclose(fp);
+	return a;
+}
+
+static int32_t ks_gzi_save(const char *fn, const int64_t *a, int64_t n) // return 0 on success or -1 on errors
+{
+	FILE *fp = fopen(fn, "wb");
+	uint8_t b[16];
+	int32_t ret = 0;
+	if (fp == 0) return -1;
+	ks_put_le64(b, n > 0? n - 1 : 0);
+	if (fwrite(b, 1, 8, fp) != 8) ret = -1;
+	for (int64_t i = 1; i < n && ret == 0; ++i) {
+		ks_put_le64(b, a[i * 2]), ks_put_le64(b + 8, a[i * 2 + 1]);
+		if (fwrite(b, 1, 16, fp) != 16) ret = -1;
+	}
+	if (fclose(fp) != 0) ret = -1;
+	return ret;
+}
+
+static int64_t ks_gzi_index(k8_file_t *ks, const char *fn) // load the BGZF index from $fn, or build it if $fn is absent; return the number of blocks or <0 on errors
+{
+	char path[K8_PATH_MAX+1];
+	if (ks->bz == 0 || ks->fn == 0) return -2;
+	if (ks->gzi) return ks->n_gzi;
+	if (fn == 0) {
+		snprintf(path, K8_PATH_MAX + 1, "%s.gzi", ks->fn);
+		fn = path;
+	}
+	if ((ks->gzi = ks_gzi_load(fn, &ks->n_gzi)) == 0)
+		ks->gzi = ks_gzi_build(ks->fn, &ks->n_gzi);
+	return ks->n_gzi < 0? -3 : ks->n_gzi;
+}
+
+static int32_t ks_useek(k8_file_t *ks, int64_t off) // seek to an uncompressed offset; BGZF files need an index from ks_gzi_index()
+{
+	int64_t lo = 0, hi;
+	if (ks->bz == 0) return ks_seek(ks, off);
+	if (off < 0) return -2;
+	if (ks->gzi == 0 || ks->n_gzi == 0) return ks->gzi? ks_seek(ks, 0) : -2; // a BGZF file without data blocks
+	for (hi = ks->n_gzi; hi - lo > 1;) { // find the last block starting at or before $off
+		int64_t mid = (lo + hi) >> 1;
+		if (ks->gzi[mid * 2 + 1] <= off) lo = mid;
+		else hi = mid;
+	}
+	if (ks_seek(ks, ks->gzi[lo * 2] << 16) < 0) return -3;
+	ks_skip(ks, off - ks->gzi[lo * 2 + 1]); // past the end of file if fewer bytes are skipped
+	return 0;
+}
+
+static int64_t ks_getuntil_set(k8_file_t *ks, const k8_bset_t *sep, int is_line, kstring_t *str, int *dret, int append) // read until any byte in $sep; a trailing '\r' is removed if $is_line
+{
+	const k8_sk_t *sk = sep->n == 1? 0 : k8_sk_get(); // k8_bset_find() calls memchr() for a single delimiter; k8_bset_space is empty before k8_sk_get()
+	int gotany = 0;
+	if (dret) *dret = 0;
+	str->l = append? str->l : 0;
+	for (;;) {
+		int i = 0;
+		if (ks_err(ks)) return -3;
+		if (ks->st >= ks->en) {
+			if (!ks->is_eof) {
+				ks_fill(ks);
+				if (ks->en == 0) { ks->is_eof = 1; break; }
+				if (ks->en == -1) { ks->is_eof = 1; return -3; }
+			} else break;
+		}
+		i = ks->st + k8_bset_find(sk, ks->buf + ks->st, ks->en - ks->st, sep);
+		K8_GROW(uint8_t, str->s, str->l + (i - ks->st), str->m);
+		gotany = 1;
+		memcpy(str->s + str->l, ks->buf + ks->st, i - ks->st);
+		str->l = str->l + (i - ks->st);
+		ks->st = i + 1;
+		if (i < ks->en) {
+			if (dret) *dret = ks->buf[i];
+			break;
+		}
+	}
+	if (!gotany && ks_eof(ks)) return -1;
+	if (str->s == 0) {
+		str->m = 1;
+		str->s = K8_CALLOC(uint8_t, 1);
+	} else if (is_line && str->l > 1 && str->s[str->l-1] == '\r') {
+		--str->l;
+	}
+	str->s[str->l] = '\0';
+	return str->l;
+}
+
+static int64_t ks_getuntil2(k8_file_t *ks, int delimiter, kstring_t *str, int *dret, int append) // $delimiter is KS_SEP_* or a byte
+{
+	k8_bset_t one;
+	const k8_bset_t *sep = &one;
+	if (delimiter == KS_SEP_SPACE) sep = &k8_bset_space;
+	else if (delimiter == KS_SEP_TAB) sep = &k8_bset_tab;
+	else if (delimiter == KS_SEP_LINE) one.n = 1, one.c[0] = '\n';
+	else if (delimiter > 0) one.n = 1, one.c[0] = delimiter;
+	else abort();
+	return ks_getuntil_set(ks, sep, delimiter == KS_SEP_LINE, str, dret, append);
+}
+
+static int64_t ks_read_fastx(k8_file_t *ks, kstring_t *name, kstring_t *seq, kstring_t *qual, kstring_t *comment) // modified from kseq_read() in kseq.h
+{
+	int32_t c, r;
+	if (ks->last_char == 0) { // then jump to the next header line
+		while ((c = ks_getc(ks)) >= 0 && c != '>' && c != '@');
+		if (c < 0) return c; // end of file or error
+		ks->last_char = c;
+	} // else: the first header char has been read in the previous call
+	comment->l = seq->l = qual->l = 0;
+	if ((r = ks_getuntil2(ks, KS_SEP_SPACE, name, &c, 0)) < 0) return r; // normal exit: EOF or error
+	if (c != '\n') ks_getuntil2(ks, KS_SEP_LINE, comment, 0, 0); // read FASTA/Q comment
+	while ((c = ks_getc(ks)) >= 0 && c != '>' && c != '+' && c != '@') {
+		if (c == '\n') continue; // skip empty lines
+		K8_GROW(uint8_t, seq->s, seq->l + 1, seq->m);
+		seq->s[seq->l++] = c;
+		ks_getuntil2(ks, KS_SEP_LINE, seq, 0, 1); // read the rest of the line
+	}
+	if (c == '>' || c == '@') ks->last_char = c; // the first header char has been read
+	K8_GROW(uint8_t, seq->s, seq->l, seq->m);
+	seq->s[seq->l] = 0;
+	ks->is_fastq = (c == '+');
+	if (!ks->is_fastq) return seq->l; // FASTA
+	while ((c = ks_getc(ks)) >= 0 && c != '\n'); // skip the rest of '+' line
+	if (c == -1) return -2; // error: no quality string
+	while ((r = ks_getuntil2(ks, KS_SEP_LINE, qual, 0, 1)) >= 0 && qual->l < seq->l);
+	if (r == -3) return -3; // stream error
+	ks->last_char = 0; // we have not come to the next header line
+	if (seq->l != qual->l) return -2; // error: qual string is of a different length
+	return seq->l;
+}
+
+/*******************************
+ *** Fundamental v8 routines ***
+ *******************************/
+
+#define K8_SAVE_PTR(_args, _index, _ptr)  (_args).This()->SetAlignedPointerInInternalField(_index, (void*)(_ptr))
+#define K8_LOAD_PTR(_args, _index, _type) ((_type*)(_args).This()->GetAlignedPointerFromInternalField(_index))
+
+static inline const char *k8_cstr(const v8::String::Utf8Value &str) // Convert a v8 string to C string
+{
+	return *str? *str : "<N/A>";
+}
+
+static k8_bytes_t *k8_get_bytes(v8::Local<v8::Value> x) // return NULL if $x is not a Bytes object
+{
+	if (!x->IsObject() || x.As<v8::Object>()->InternalFieldCount() == 0) return 0;
+	k8_bytes_t *a = (k8_bytes_t*)x.As<v8::Object>()->GetAlignedPointerFromInternalField(0);
+	return a && a->magic == K8_BYTES_MAGIC? a : 0;
+}
+
+static inline void k8_bytes_sync(v8::Isolate *isolate, k8_bytes_t *a) // report the change in capacity to V8
+{
+	if (a->buf.m != a->n_ext) {
+		isolate->AdjustAmountOfExternalAllocatedMemory(a->buf.m - a->n_ext);
+		a->n_ext = a->buf.m;
+	}
+}
+
+static int32_t k8_get_opt_int(v8::Isolate *isolate, v8::Local<v8::Value> opt, const char *key, int32_t def) // get an integer from an option object
+{
+	if (!opt->IsObject()) return def;
+	v8::Local<v8::Context> context = isolate->GetCurrentContext();
+	v8::Local<v8::Value> x;
+	if (!opt.As<v8::Object>()->Get(context, v8::String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocal(&x) || x->IsUndefined())
+		return def;
+	return x->Int32Value(context).FromMaybe(def);
+}
+
+static int32_t k8_get_opt_str(v8::Isolate *isolate, v8::Local<v8::Value> opt, const char *key, char *buf, int32_t size) // copy a string option to $buf; return its length or -1 if absent
+{
+	if (!opt->IsObject()) return -1;
+	v8::Local<v8::Context> context = isolate->GetCurrentContext();
+	v8::Local<v8::Value> x;
+	if (!opt.As<v8::Object>()->Get(context, v8::String::NewFromUtf8(isolate, key).ToLocalChecked()).ToLocal(&x) || !x->IsString())
+		return -1;
+	v8::String::Utf8Value str(isolate, x);
+	snprintf(buf, size, "%s", k8_cstr(str));
+	return strlen(buf);
+}
+
+#define K8_EXT_STR_MIN 1024 // shorter strings are always copied to the V8 heap
+
+class k8_ext_str_t : public v8::String::ExternalOneByteStringResource { // string data outside the V8 heap: a copy, or a range of an ArrayBuffer kept alive by $bs
+public:
+	k8_ext_str_t(const char *s, size_t l, std::shared_ptr<v8::BackingStore> bs) : s_(s), l_(l), bs_(bs) {}
+	~k8_ext_str_t() { if (!bs_) free((void*)s_); }
+	const char *data() const override { return s_; }
+	size_t length() const override { return l_; }
+private:
+	const char *s_;
+	size_t l_;
+	std::shared_ptr<v8::BackingStore> bs_;
+};
+
+static int32_t k8_is_ascii(const uint8_t *s, int64_t len)
+{
+	uint64_t x = 0, y;
+	int64_t i;
+	for (i = 0; i + 8 <= len; i += 8)
+		memcpy(&y, s + i, 8), x |= y;
+	for (; i < len; ++i) x |= s[i];
+	return !(x & 0x8080808080808080ULL);
+}
+
+static v8::MaybeLocal<v8::String> k8_new_string(v8::Isolate *isolate, const uint8_t *s, int64_t len, int32_t utf8, int32_t ext, std::shared_ptr<v8::BackingStore> bs) // if $ext, create an external string backed by $bs, or by a copy if $bs is NULL
+{
+	if (ext && !k8_making_snapshot && len >= K8_EXT_STR_MIN && (!utf8 || k8_is_ascii(s, len))) { // ASCII is the same in Latin-1 and UTF-8; external strings can't be serialized
+		char *p = (char*)s;
+		if (!bs) {
+			if ((p = K8_MALLOC(char, len)) == 0) return v8::MaybeLocal<v8::String>();
+			memcpy(p, s, len);
+		}
+		k8_ext_str_t *r = new k8_ext_str_t(p, len, bs);
+		v8::MaybeLocal<v8::String> str = v8::String::NewExternalOneByte(isolate, r);
+		if (str.IsEmpty()) delete r; // not taken by V8; the string is too long
+		return str;
+	}
+	if (utf8) return v8::String::NewFromUtf8(isolate, (const char*)s, v8::NewStringType::kNormal, len);
+	return v8::String::NewFromOneByte(isolate, s, v8::NewStringType::kNormal, len);
+}
+
+static void k8_exception(v8::Isolate* isolate, v8::TryCatch* try_catch) // Exception handling. Adapted from v8/shell.cc
+{
+	v8::HandleScope handle_scope(isolate);
+	v8::String::Utf8Value exception(isolate, try_catch->Exception());
+	const char* exception_string = k8_cstr(exception);
+	v8::Local<v8::Message> message = try_catch->Message();
+	if (message.IsEmpty()) {
+		// v8 didn't provide any extra information about this error; just print the exception.
+		fprintf(stderr, "%s\n", exception_string);
+	} else {
+		// Print (filename):(line number): (message).
+		v8::String::Utf8Value filename(isolate, message->GetScriptOrigin().ResourceName());
+		v8::Local<v8::Context> context(isolate->GetCurrentContext());
+		const char* filename_string = k8_cstr(filename);
+		int linenum = message->GetLineNumber(context).FromJust();
+		fprintf(stderr, "%s:%i: %s\n", filename_string, linenum, exception_string);
+		// Print line of source code.
+		v8::String::Utf8Value sourceline(isolate, message->GetSourceLine(context).ToLocalChecked());
+		const char* sourceline_string = k8_cstr(sourceline);
+		fprintf(stderr, "%s\n", sourceline_string);
+		// Print wavy underline (GetUnderline is deprecated).
+		int start = message->GetStartColumn(context).FromJust();
+		for (int i = 0; i < start; i++) fputc(' ', stderr);
+		int end = message->GetEndColumn(context).FromJust();
+		for (int i = start; i < end; i++) fputc('^', stderr);
+		fputc('\n', stderr);
+		v8::Local<v8::Value> stack_trace_string;
+		if (try_catch->StackTrace(context).ToLocal(&stack_trace_string) &&
+				stack_trace_string->IsString() &&
+				stack_trace_string.As<v8::String>()->Length() > 0)
+		{
+			v8::String::Utf8Value stack_trace(isolate, stack_trace_string);
+			const char* err = k8_cstr(stack_trace);
+			fputs(err, stderr); fputc('\n', stderr);
+		}
+	}
+}
+
+static int k8_cache_path(const char *fn, char *path) // code cache of $fn under $K8_CACHE_DIR, keyed by path, mtime, size and versions
+{
+	char *dir = getenv("K8_CACHE_DIR"), abspath[K8_PATH_MAX+1], key[K8_PATH_MAX+128];
+	struct stat st;
+	uint64_t h = 0xcbf29ce484222325ULL; // FNV-1a
+	if (dir == 0 || *dir == 0 || strlen(dir) + 24 > K8_PATH_MAX) return -1;
+	if (realpath(fn, abspath) == 0 || stat(abspath, &st) < 0) return -1;
+	snprintf(key, sizeof(key), "%s\t%lld\t%lld\t%s\t%s", abspath, (long long)st.st_mtime, (long long)st.st_size, v8::V8::GetVersion(), K8_VERSION);
+	for (const char *p = key; *p; ++p)
+		h = (h ^ (uint8_t)*p) * 0x100000001b3ULL;
+	snprintf(path, K8_PATH_MAX + 1, "%s/%.16llx.jsc", dir, (unsigned long long)h);
+	return 0;
+}
+
+static void k8_cache_save(const char *path, v8::Local<v8::UnboundScript> script) // write to a temporary file first as other processes may be reading
+{
+	char tmp[K8_PATH_MAX+64];
+	FILE *fp;
+	v8::ScriptCompiler::CachedData *cd = v8::ScriptCompiler::CreateCodeCache(script);
+	if (cd == 0) return;
+	snprintf(tmp, sizeof(tmp), "%s.%ld.%lx", path, (long)getpid(), (unsigned long)pthread_self());
+	if ((fp = fopen(tmp, "wb")) != 0) {
+		bool ok = (fwrite(cd->data, 1, cd->length, fp) == (size_t)cd->length);
+		if (fclose(fp) != 0) ok = false;
+		if (!ok || rename(tmp, path) != 0) unlink(tmp);
+	}
+	delete cd;
+}
+
+typedef struct { // a script being run whose code cache is to be saved
+	char *path;
+	v8::Global<v8::UnboundScript> *script;
+} k8_cache_job_t;
+
+static __thread int32_t k8_cache_n, k8_cache_m;
+static __thread k8_cache_job_t *k8_cache_jobs; // per isolate thread; load() nests scripts
+
+static void k8_cache_pop(v8::Isolate *isolate, bool save) // finish the innermost script
+{
+	k8_cache_job_t *j = &k8_cache_jobs[--k8_cache_n];
+	if (save) k8_cache_save(j->path, j->script->Get(isolate));
+	j->script->Reset();
+	delete j->script;
+	free(j->path);
+}
+
+static void k8_cache_flush(v8::Isolate *isolate) // save the caches of scripts still running, as exit() does not return to k8_execute()
+{
+	v8::HandleScope handle_scope(isolate);
+	while (k8_cache_n > 0) k8_cache_pop(isolate, true);
+}
+
+static bool k8_execute(v8::Isolate* isolate, v8::Local<v8::String> source, v8::Local<v8::Value> name, bool prt_rst, const char *fn) // Execute JS in a string. Adapted from v8/shell.cc. $fn, if not NULL, is the source file used for code caching
+{
+	v8::HandleScope handle_scope(isolate);
+	v8::TryCatch try_catch(isolate);
+	v8::ScriptOrigin origin(isolate, name);
+	v8::Local<v8::Context> context(isolate->GetCurrentContext());
+	v8::Local<v8::Script> script;
+	v8::ScriptCompiler::CachedData *cd = 0;
+	char cache_fn[K8_PATH_MAX+1];
+	kstring_t cache = {0,0,0};
+	bool to_save = false, compiled;
+	if (fn && k8_cache_path(fn, cache_fn) == 0) {
+		k8_file_t *ks = ks_open(-1, cache_fn, 0, 0, -1);
+		if (ks) {
+			if (ks_read_all(ks, &cache) > 0)
+				cd = new v8::ScriptCompiler::CachedData(cache.s, cache.l); // not owning cache.s
+			ks_close(ks);
+		}
+		to_save = true;
+	}
+	{
+		v8::ScriptCompiler::Source src(source, origin, cd); // $src takes the ownership of $cd
+		compiled = v8::ScriptCompiler::Compile(context, &src, cd? v8::ScriptCompiler::kConsumeCodeCache : v8::ScriptCompiler::kNoCompileOptions).ToLocal(&script);
+		if (cd && !src.GetCachedData()->rejected) to_save = false; // otherwise V8 has compiled from the source
+	}
+	free(cache.s);
+	if (!compiled) {
+		k8_exception(isolate, &try_catch);
+		return false;
+	} else {
+		v8::Local<v8::Value> result;
+		if (to_save) { // saved after running such that functions called at the top level are included
+			K8_GROW(k8_cache_job_t, k8_cache_jobs, k8_cache_n, k8_cache_m);
+			k8_cache_jobs[k8_cache_n].path = strdup(cache_fn);
+			k8_cache_jobs[k8_cache_n++].script = new v8::Global<v8::UnboundScript>(isolate, script->GetUnboundScript());
+		}
+		bool ok = script->Run(context).ToLocal(&result);
+		if (to_save && k8_cache_n > 0) k8_cache_pop(isolate, ok); // exit() in a worker has saved the caches
+		if (!ok) {
+			assert(try_catch.HasCaught());
+			if (!try_catch.HasTerminated()) k8_exception(isolate, &try_catch); // not for exit() in a worker
+			return false;
+		} else {
+			assert(!try_catch.HasCaught());
+			if (prt_rst && !result->IsUndefined()) {
+				// If all went well and the result wasn't undefined then print the returned value.
+				v8::String::Utf8Value str(isolate, result);
+				if (ks_std_buf[0]) ks_flush(ks_std_buf[0]);
+				puts(k8_cstr(str));
+			}
+			return true;
+		}
+	}
+}
+
+v8::MaybeLocal<v8::String> k8_readfile(v8::Isolate* isolate, const char *name) // Read an entire file. Adapted from v8/shell.cc
+{
+	kstring_t str = {0,0,0};
+	k8_file_t *ks = ks_open(-1, name, 0, 0, -1);
+	if (ks == 0) {
+		fprintf(stderr, "ERROR: fail to open file '%s'.\n", name);
+		return v8::Handle<v8::String>();
+	}
+	ks_read_all(ks, &str);
+	ks_close(ks);
+
+	if (str.l > 2 && strncmp((char*)str.s, "#!", 2) == 0) { // then skip the "#!" line
+		int64_t i;
+		for (i = 0; i < str.l; ++i)
+			if (str.s[i] == '\n') break;
+		str.l -= i + 1;
+		memmove(str.s, &str.s[i+1], str.l);
+	}
+	v8::MaybeLocal<v8::String> result = v8::String::NewFromUtf8(isolate, (char*)str.s, v8::NewStringType::kNormal, str.l);
+	free(str.s);
+	return result;
+}
+
+/********************
+ *** CPU profiler ***
+ ********************/
+
+static v8::CpuProfiler *k8_prof = 0;
+static v8::Isolate *k8_prof_isolate = 0; // the profiled isolate; exit() may be called from workers
+static const char *k8_prof_fn = 0; // set by --cpu-profile=FILE
+static int k8_prof_intv = 1000; // sampling interval in microseconds
+
+static void k8_prof_start(v8::Isolate *isolate)
+{
+	if (k8_prof_fn == 0 || k8_prof) return;
+	k8_prof = v8::CpuProfiler::New(isolate, v8::kDebugNaming);
+	k8_prof_isolate = isolate;
+	k8_prof->SetSamplingInterval(k8_prof_intv);
+	k8_prof->StartProfiling(v8::String::Empty(isolate), true); // record samples for .cpuprofile
+}
+
+static void k8_prof_puts(kstring_t *s, const char *p, int64_t l)
+{
+	K8_GROW(uint8_t, s->s, s->l + l, s->m);
+	memcpy(&s->s[s->l], p, l);
+	s->l += l;
+}
+
+static void k8_prof_fold(FILE *fp, const v8::CpuProfileNode *p, kstring_t *stk) // one "f1;f2;...;fn count" line per node with samples
+{
+	int64_t l0 = stk->l;
+	if (p->GetParent()) { // skip "(root)"
+		const char *name = p->GetFunctionNameStr(), *url = p->GetScriptResourceNameStr(), *q;
+		char buf[32];
+		if (stk->l) k8_prof_puts(stk, ";", 1);
+		if (*name == 0) name = "(anonymous)";
+		for (q = name; *q; ++q) k8_prof_puts(stk, *q == ';'? ":" : q, 1); // ';' separates frames
+		if (url && *url) { // JavaScript frames; native callbacks such as File.prototype.readline have no script
+			const char *b = strrchr(url, '/');
+			k8_prof_puts(stk, " (", 2);
+			k8_prof_puts(stk, b? b + 1 : url, strlen(b? b + 1 : url));
+			k8_prof_puts(stk, buf, snprintf(buf, 32, ":%d)", p->GetLineNumber()));
+		}
+		if (p->GetHitCount() > 0)
+			fprintf(fp, "%.*s %u\n", (int)stk->l, (char*)stk->s, p->GetHitCount());
+	}
+	for (int i = 0; i < p->GetChildrenCount(); ++i)
+		k8_prof_fold(fp, p->GetChild(i), stk);
+	stk->l = l0;
+}
+
+static void k8_prof_json_str(FILE *fp, const char *s)
+{
+	fputc('"', fp);
+	for (; *s; ++s) {
+		uint8_t c = *s;
+		if (c == '"' || c == '\\') fputc('\\', fp), fputc(c, fp);
+		else if (c < 0x20) fprintf(fp, "\\u%.4x", c);
+		else fputc(c, fp);
+	}
+	fputc('"', fp);
+}
+
+static void k8_prof_json_node(FILE *fp, const v8::CpuProfileNode *p) // nodes in the Chrome DevTools .cpuprofile format
+{
+	int i, n = p->GetChildrenCount();
+	fprintf(fp, "%s{\"id\":%u,\"callFrame\":{\"functionName\":", p->GetParent()? ",\n" : "", p->GetNodeId());
+	k8_prof_json_str(fp, p->GetFunctionNameStr());
+	fprintf(fp, ",\"scriptId\":\"%d\",\"url\":", p->GetScriptId());
+	k8_prof_json_str(fp, p->GetScriptResourceNameStr());
+	fprintf(fp, ",\"lineNumber\":%d,\"columnNumber\":%d},\"hitCount\":%u,\"children\":[", p->GetLineNumber() - 1, p->GetColumnNumber() - 1, p->GetHitCount()); // 0-based
+	for (i = 0; i < n; ++i)
+		fprintf(fp, "%s%u", i? "," : "", p->GetChild(i)->GetNodeId());
+	fputs("]}", fp);
+	for (i = 0; i < n; ++i)
+		k8_prof_json_node(fp, p->GetChild(i));
+}
+
+static int k8_prof_names(const char *out, char *fn_fold, char *fn_json) // OUT.folded or OUT gives OUT.cpuprofile; OUT.cpuprofile gives OUT.folded; return -1 if a name is too long
+{
+	int l = strlen(out);
+	if (l > K8_PATH_MAX) return -1;
+	if (l > 11 && strcmp(out + l - 11, ".cpuprofile") == 0) {
+		strcpy(fn_json, out);
+		return snprintf(fn_fold, K8_PATH_MAX + 1, "%.*s.folded", l - 11, out) > K8_PATH_MAX? -1 : 0;
+	}
+	if (l > 7 && strcmp(out + l - 7, ".folded") == 0) l -= 7;
+	strcpy(fn_fold, out);
+	return snprintf(fn_json, K8_PATH_MAX + 1, "%.*s.cpuprofile", l, out) > K8_PATH_MAX? -1 : 0;
+}
+
+static void k8_prof_stop(v8::Isolate *isolate) // write folded stacks and the .cpuprofile JSON; see k8_prof_names()
+{
+	if (k8_prof == 0 || isolate != k8_prof_isolate) return;
+	v8::HandleScope handle_scope(isolate);
+	v8::CpuProfile *prof = k8_prof->StopProfiling(v8::String::Empty(isolate));
+	if (prof) {
+		char fn_fold[K8_PATH_MAX+1], fn[K8_PATH_MAX+1];
+		FILE *fp;
+		if (k8_prof_names(k8_prof_fn, fn_fold, fn) < 0) {
+			fprintf(stderr, "ERROR: file name '%s' is too long for the profile\n", k8_prof_fn);
+			fn_fold[0] = fn[0] = 0;
+		}
+		if (fn_fold[0] && (fp = fopen(fn_fold, "w")) != 0) {
+			kstring_t stk = {0,0,0};
+			k8_prof_fold(fp, prof->GetTopDownRoot(), &stk);
+			free(stk.s);
+			fclose(fp);
+		} else if (fn_fold[0]) fprintf(stderr, "ERROR: failed to write file '%s'\n", fn_fold);
+		if (fn[0] && (fp = fopen(fn, "w")) != 0) {
+			int64_t t = prof->GetStartTime();
+			int i, n = prof->GetSamplesCount();
+			fputs("{\"nodes\":[", fp);
+			k8_prof_json_node(fp, prof->GetTopDownRoot());
+			fprintf(fp, "],\n\"startTime\":%lld,\"endTime\":%lld,\n\"samples\":[", (long long)t, (long long)prof->GetEndTime());
+			for (i = 0; i < n; ++i)
+				fprintf(fp, "%s%u", i? "," : "", prof->GetSample(i)->GetNodeId());
+			fputs("],\n\"timeDeltas\":[", fp);
+			for (i = 0; i < n; ++i) {
+				int64_t ti = prof->GetSampleTimestamp(i);
+				fprintf(fp, "%s%lld", i? "," : "", (long long)(ti - t));
+				t = ti;
+			}
+			fputs("]}\n", fp);
+			fclose(fp);
+		} else if (fn[0]) fprintf(stderr, "ERROR: failed to write file '%s'\n", fn);
+		prof->Delete();
+	}
+	k8_prof->Dispose();
+	k8_prof = 0, k8_prof_isolate = 0;
+}
+
+/***************************
+ *** Run-time statistics ***
+ ***************************/
+
+static v8::Isolate *k8_stats_isolate = 0; // the isolate being reported; exit() may be called from workers
+static double k8_stats_t0, k8_gc_t0, k8_gc_max, k8_gc_time[3]; // GC pauses: scavenges, mark-compacts and others
+static int64_t k8_gc_n[3];
+
+static void k8_gc_prologue(v8::Isolate *isolate, v8::GCType type, v8::GCCallbackFlags flags) { k8_gc_t0 = k8_realtime(); }
+
+static void k8_gc_epilogue(v8::Isolate *isolate, v8::GCType type, v8::GCCallbackFlags flags)
+{
+	double t = k8_realtime() - k8_gc_t0;
+	int32_t i = type == v8::kGCTypeScavenge || type == v8::kGCTypeMinorMarkCompact? 0 : type == v8::kGCTypeMarkSweepCompact? 1 : 2;
+	++k8_gc_n[i], k8_gc_time[i] += t;
+	if (t > k8_gc_max) k8_gc_max = t;
+}
+
+static void k8_stats_start(v8::Isolate *isolate)
+{
+	if (!k8_stats_on || k8_stats_t0 > 0.0) return;
+	k8_stats_t0 = k8_realtime(), k8_stats_isolate = isolate;
+	isolate->AddGCPrologueCallback(k8_gc_prologue);
+	isolate->AddGCEpilogueCallback(k8_gc_epilogue);
+}
+
+static void k8_stats_print_file(const char *fn, const ks_stat_t *t)
+{
+	fprintf(stderr, "[k8 stats] file %s: in=%lld zin=%lld fills=%lld fill_time=%.3fs lines=%lld records=%lld out=%lld zout=%lld flushes=%lld flush_time=%.3fs\n",
+			fn, (long long)t->n_in, (long long)t->z_in, (long long)t->n_fill, t->t_fill, (long long)t->n_line, (long long)t->n_rec,
+			(long long)t->n_out, (long long)t->z_out, (long long)t->n_flush, t->t_flush);
+}
+
+static void k8_stats_report(v8::Isolate *isolate) // print statistics to stderr; called once at exit, only from the main isolate
+{
+	const double mb = 1024.0 * 1024.0;
+	v8::HeapStatistics hs;
+	struct rusage ru;
+	int32_t i;
+	if (k8_stats_t0 <= 0.0 || isolate != k8_stats_isolate) return;
+	ks_flush_live(); // count the data still in the output buffers and compressors; only files of this thread, the same as listed below
+	getrusage(RUSAGE_SELF, &ru);
+#ifdef __APPLE__
+	double rss = ru.ru_maxrss / mb; // in bytes on macOS
+#else
+	double rss = ru.ru_maxrss / 1024.0; // in kilobytes on Linux
+#endif
+	fprintf(stderr, "[k8 stats] time: wall=%.3fs user=%.3fs sys=%.3fs max_rss=%.1fMB\n", k8_realtime() - k8_stats_t0,
+			ru.ru_utime.tv_sec + ru.ru_utime.tv_usec * 1e-6, ru.ru_stime.tv_sec + ru.ru_stime.tv_usec * 1e-6, rss);
+	isolate->GetHeapStatistics(&hs);
+	fprintf(stderr, "[k8 stats] heap: used=%.1fMB total=%.1fMB limit=%.1fMB external=%.1fMB malloced=%.1fMB peak_malloced=%.1fMB\n",
+			hs.used_heap_size() / mb, hs.total_heap_size() / mb, hs.heap_size_limit() / mb, hs.external_memory() / mb,
+			hs.malloced_memory() / mb, hs.peak_malloced_memory() / mb);
+	fprintf(stderr, "[k8 stats] gc: scavenge=%lld/%.3fs mark_compact=%lld/%.3fs other=%lld/%.3fs max_pause=%.3fs\n",
+			(long long)k8_gc_n[0], k8_gc_time[0], (long long)k8_gc_n[1], k8_gc_time[1], (long long)k8_gc_n[2], k8_gc_time[2], k8_gc_max);
+	pthread_mutex_lock(&ks_live_lock);
+	for (i = 0; i < ks_stat_n_done; ++i)
+		k8_stats_print_file(ks_stat_done[i].fn, &ks_stat_done[i].stat);
+	for (i = 0; i < ks_n_live; ++i) { // files of running workers are being used by other threads
+		if (!pthread_equal(ks_live[i]->tid, pthread_self())) continue;
+		ks_stat_sync(ks_live[i]);
+		k8_stats_print_file(ks_live[i]->fn, &ks_live[i]->stat);
+	}
+	pthread_mutex_unlock(&ks_live_lock);
+	isolate->RemoveGCPrologueCallback(k8_gc_prologue);
+	isolate->RemoveGCEpilogueCallback(k8_gc_epilogue);
+	k8_stats_t0 = 0.0, k8_stats_isolate = 0;
+}
+
+/******************************
+ *** New built-in functions ***
+ ******************************/
+
+static void k8_write_value(v8::Isolate *isolate, k8_file_t *ks, v8::Local<v8::Value> x) // write to the output buffer of $ks without allocating memory in most cases
+{
+	k8_bytes_t *a;
+	if (x->IsString()) {
+		int64_t len = x.As<v8::String>()->Length();
+		x.As<v8::String>()->WriteOneByte(isolate, ks_reserve(ks, len), 0, len, v8::String::NO_NULL_TERMINATION);
+		ks->out.l += len;
+	} else if (x->IsInt32()) {
+		ks_write_int(ks, x.As<v8::Int32>()->Value());
+	} else if (x->IsNumber() && fabs(x.As<v8::Number>()->Value()) < 9007199254740992.0 && x.As<v8::Number>()->Value() == (double)(int64_t)x.As<v8::Number>()->Value()) {
+		ks_write_int(ks, (int64_t)x.As<v8::Number>()->Value()); // integers up to 2^53 are printed the same way as JavaScript
+	} else if (x->IsArrayBuffer()) {
+		void *data = x.As<v8::ArrayBuffer>()->GetBackingStore()->Data();
+		int64_t len = x.As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
+		ks_write(ks, (uint8_t*)data, len);
+	} else if ((a = k8_get_bytes(x)) != 0) {
+		ks_write(ks, a->buf.s, a->buf.l);
+	} else if (x->IsNumber()) {
+		v8::Local<v8::String> str = x->ToString(isolate->GetCurrentContext()).ToLocalChecked();
+		k8_write_value(isolate, ks, str);
+	} else {
+		v8::String::Utf8Value str(isolate, x);
+		const char *p = k8_cstr(str);
+		ks_write(ks, (const uint8_t*)p, strlen(p));
+	}
+}
+
+static void k8_print(const v8::FunctionCallbackInfo<v8::Value> &args) // print(): print to stdout; TAB demilited if multiple arguments are provided
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = ks_std(0);
+	for (int32_t i = 0; i < args.Length(); i++) {
+		if (i) ks_putc(ks, '\t');
+		k8_write_value(args.GetIsolate(), ks, args[i]);
+	}
+	ks_putc(ks, '\n');
+	if (ks->out_sync) ks_flush(ks);
+}
+
+static void k8_warn(const v8::FunctionCallbackInfo<v8::Value> &args) // warn(): similar print() but print to stderr
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = ks_std(1);
+	for (int32_t i = 0; i < args.Length(); i++) {
+		if (i) ks_putc(ks, '\t');
+		k8_write_value(args.GetIsolate(), ks, args[i]);
+	}
+	ks_putc(ks, '\n');
+	ks_flush(ks);
+}
+
+static pthread_mutex_t k8_iso_lock = PTHREAD_MUTEX_INITIALIZER;
+static int32_t k8_n_iso, k8_m_iso, k8_exit_req, k8_exit_code; // exit() called from a worker is carried out by the main thread
+static v8::Isolate **k8_iso; // isolates running scripts, including the main one
+static v8::Isolate *k8_main_isolate = 0;
+
+static void k8_worker_join_all(void);
+
+static void k8_isolate_add(v8::Isolate *isolate)
+{
+	pthread_mutex_lock(&k8_iso_lock);
+	K8_GROW(v8::Isolate*, k8_iso, k8_n_iso, k8_m_iso);
+	k8_iso[k8_n_iso++] = isolate;
+	if (k8_exit_req) isolate->TerminateExecution(); // exit() has been called before this worker started
+	pthread_mutex_unlock(&k8_iso_lock);
+}
+
+static void k8_isolate_del(v8::Isolate *isolate)
+{
+	pthread_mutex_lock(&k8_iso_lock);
+	for (int32_t i = 0; i < k8_n_iso; ++i)
+		if (k8_iso[i] == isolate) {
+			memmove(&k8_iso[i], &k8_iso[i + 1], (k8_n_iso - i - 1) * sizeof(v8::Isolate*));
+			--k8_n_iso;
+			break;
+		}
+	pthread_mutex_unlock(&k8_iso_lock);
+}
+
+static void k8_exit_request(int32_t code) // stop the scripts in all isolates; the first exit() sets the exit code
+{
+	pthread_mutex_lock(&k8_iso_lock);
+	if (!k8_exit_req) k8_exit_req = 1, k8_exit_code = code;
+	for (int32_t i = 0; i < k8_n_iso; ++i)
+		k8_iso[i]->TerminateExecution();
+	pthread_mutex_unlock(&k8_iso_lock);
+}
+
+static void k8_exit(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	int exit_code = args[0]->Int32Value(args.GetIsolate()->GetCurrentContext()).FromMaybe(0);
+	if (args.GetIsolate() != k8_main_isolate) { // in a worker; the main thread exits after its script is stopped and workers are joined
+		v8::Local<v8::Context> context = args.GetIsolate()->GetCurrentContext();
+		v8::Local<v8::Script> noop;
+		k8_cache_flush(args.GetIsolate());
+		k8_exit_request(exit_code);
+		if (v8::Script::Compile(context, v8::String::NewFromUtf8Literal(args.GetIsolate(), "0")).ToLocal(&noop))
+			noop->Run(context).IsEmpty(); // enter JS so that the termination takes effect before the next statement
+		return;
+	}
+	k8_prof_stop(args.GetIsolate());
+	k8_stats_report(args.GetIsolate());
+	k8_cache_flush(args.GetIsolate());
+	k8_exit_request(exit_code);
+	k8_worker_join_all(); // workers must not be running in V8 when the process exits
+	ks_flush_live();
+	ks_std_destroy();
+	fflush(stdout); fflush(stderr);
+	exit(exit_code);
+}
+
+static bool k8_preloaded(v8::Isolate *isolate, const char *fn) // test if $fn has been evaluated in the startup snapshot; record $fn when making a snapshot
+{
+	char path[K8_PATH_MAX+1];
+	v8::Local<v8::Context> context = isolate->GetCurrentContext();
+	v8::Local<v8::Private> key = v8::Private::ForApi(isolate, v8::String::NewFromUtf8Literal(isolate, "k8_preloaded"));
+	v8::Local<v8::Value> list = context->Global()->GetPrivate(context, key).ToLocalChecked();
+	if (!list->IsArray() || realpath(fn, path) == 0) return false;
+	v8::Local<v8::Array> a = list.As<v8::Array>();
+	for (uint32_t i = 0; i < a->Length(); ++i) {
+		v8::String::Utf8Value s(isolate, a->Get(context, i).ToLocalChecked());
+		if (strcmp(*s, path) == 0) return true;
+	}
+	if (k8_making_snapshot)
+		a->Set(context, a->Length(), v8::String::NewFromUtf8(isolate, path).ToLocalChecked()).FromJust();
+	return false;
+}
+
+static void k8_load(const v8::FunctionCallbackInfo<v8::Value> &args) // load(): Load and execute a JS file. It also searches ONE path in $K8_PATH
+{
+	char *env_path = getenv("K8_PATH");
+	char abspath[K8_PATH_MAX+1], buf[K8_PATH_MAX+1];
+	FILE *fp;
+	int32_t k;
+	realpath(k8_src_path, abspath);
+	for (k = strlen(abspath) - 1; k >= 0; --k)
+		if (abspath[k] == '/') break;
+	assert(k >= 0);
+	abspath[++k] = 0;
+	for (int i = 0; i < args.Length(); i++) {
 		v8::HandleScope handle_scope(args.GetIsolate());
 		v8::String::Utf8Value file(args.GetIsolate(), args[i]);
 		int32_t l_fn = strlen(*file);
@@ -435,421 +2471,2743 @@ static void k8_load(const v8::FunctionCallbackInfo<v8::Value> &args) // load():
 				fclose(fp);
 			}
 		}
-		if (buf[0] == 0 && k + l_fn < K8_PATH_MAX) { // 2) the script directory
-			strcpy(&abspath[k], *file);
-			if ((fp = fopen(abspath, "r")) != 0) {
-				strcpy(buf, abspath);
-				fclose(fp);
-			}
+		if (buf[0] == 0 && k + l_fn < K8_PATH_MAX) { // 2) the script directory
+			strcpy(&abspath[k], *file);
+			if ((fp = fopen(abspath, "r")) != 0) {
+				strcpy(buf, abspath);
+				fclose(fp);
+			}
+		}
+		if (buf[0] == 0 && env_path && strlen(env_path) + l_fn < K8_PATH_MAX) { // 3) a directory on K8_PATH. TODO: to allow multiple paths separated by ":"
+			strcpy(buf, env_path); strcat(buf, "/"); strcat(buf, *file);
+			if ((fp = fopen(buf, "r")) != 0) fclose(fp);
+		}
+		if (buf[0] == 0) {
+			args.GetIsolate()->ThrowError("[load] fail to locate the file");
+			return;
+		}
+		if (k8_preloaded(args.GetIsolate(), buf)) continue;
+		v8::Local<v8::String> source;
+		if (!k8_readfile(args.GetIsolate(), buf).ToLocal(&source)) {
+			args.GetIsolate()->ThrowError("[load] fail to read the file");
+			return;
+		}
+		if (!k8_execute(args.GetIsolate(), source, args[i], false, buf)) {
+			if (!args.GetIsolate()->IsExecutionTerminating()) args.GetIsolate()->ThrowError("[load] fail to execute the file");
+			return;
+		}
+	}
+}
+
+static void k8_munmap_delete_cb(void *data, size_t len, void *aux) { munmap(data, len); }
+static void k8_free_delete_cb(void *data, size_t len, void *aux) { free(data); }
+
+static void k8_read_file(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_read_file(fn, opt?)
+{
+	if (args.Length() < 1) return;
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	v8::String::Utf8Value fn(isolate, args[0]);
+	if (args.Length() >= 2 && k8_get_opt_int(isolate, args[1], "mmap", 0)) { // ArrayBuffer backed by a private mapping of an uncompressed file
+		int64_t len;
+		uint8_t *mm = ks_mmap(*fn, &len, 1);
+		if (mm) {
+			args.GetReturnValue().Set(v8::ArrayBuffer::New(isolate, v8::ArrayBuffer::NewBackingStore(mm, len, k8_munmap_delete_cb, 0)));
+			return;
+		}
+	}
+	k8_file_t *fp = ks_open(-1, *fn, "r", 0, -1);
+	if (fp == 0) return;
+	kstring_t buf = {0,0,0};
+	int64_t ret = ks_read_all(fp, &buf); // buf.s is exactly sized for an uncompressed file
+	ks_close(fp);
+	if (ret >= 0) { // hand buf.s over to the ArrayBuffer without copying
+		if (buf.m > buf.l + 1) buf.s = K8_REALLOC(uint8_t, buf.s, buf.l + 1); // trim the geometric growth for gzip'd input
+		args.GetReturnValue().Set(v8::ArrayBuffer::New(isolate, v8::ArrayBuffer::NewBackingStore(buf.s, buf.l, k8_free_delete_cb, 0)));
+	} else free(buf.s);
+}
+
+static void k8_encode(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (args.Length() == 0 || !args[0]->IsString()) return;
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	int32_t type = 0; // Latin-1
+	if (args.Length() >= 2) {
+		v8::String::Utf8Value e(isolate, args[1]);
+		if (strcmp(*e, "utf8") == 0 || strcmp(*e, "utf-8") == 0 || strcmp(*e, "UTF8") == 0 || strcmp(*e, "UTF-8") == 0)
+			type = 1; // UTF-8
+	}
+	if (type == 0) {
+		v8::Handle<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(isolate, args[0].As<v8::String>()->Length());
+		args[0].As<v8::String>()->WriteOneByte(isolate, (uint8_t*)ab->GetBackingStore()->Data(), 0, -1, v8::String::NO_NULL_TERMINATION);
+		args.GetReturnValue().Set(ab);
+	} else if (type == 1) {
+		v8::Handle<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(isolate, args[0].As<v8::String>()->Utf8Length(isolate));
+		args[0].As<v8::String>()->WriteUtf8(isolate, (char*)ab->GetBackingStore()->Data(), -1, 0, v8::String::NO_NULL_TERMINATION);
+		args.GetReturnValue().Set(ab);
+	}
+}
+
+static void k8_decode(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_decode(buf, enc?, opt?)
+{
+	if (args.Length() == 0) return;
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *data = 0;
+	int64_t len = 0;
+	std::shared_ptr<v8::BackingStore> bs; // NULL for Bytes as it may be modified later
+	if (args[0]->IsArrayBuffer())  {
+		bs = args[0].As<v8::ArrayBuffer>()->GetBackingStore();
+		data = (uint8_t*)bs->Data(), len = bs->ByteLength();
+	} else if (args[0]->IsArrayBufferView()) {
+		v8::Local<v8::ArrayBufferView> v = args[0].As<v8::ArrayBufferView>();
+		bs = v->Buffer()->GetBackingStore();
+		data = (uint8_t*)bs->Data() + v->ByteOffset(), len = v->ByteLength();
+	} else {
+		k8_bytes_t *a = k8_get_bytes(args[0]);
+		if (a) data = a->buf.s? a->buf.s : (uint8_t*)"", len = a->buf.l;
+	}
+	if (data == 0) return;
+	int32_t type = 0; // Latin-1
+	if (args.Length() >= 2 && !args[1]->IsUndefined()) {
+		v8::String::Utf8Value e(isolate, args[1]);
+		if (strcmp(*e, "utf8") == 0 || strcmp(*e, "utf-8") == 0 || strcmp(*e, "UTF8") == 0 || strcmp(*e, "UTF-8") == 0)
+			type = 1; // UTF-8
+	}
+	int32_t ext = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "external", 0) : 0;
+	v8::Local<v8::String> str;
+	if (k8_new_string(isolate, data, len, type, ext, bs).ToLocal(&str))
+		args.GetReturnValue().Set(str);
+}
+
+static void k8_version(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	args.GetReturnValue().Set(v8::String::NewFromUtf8Literal(args.GetIsolate(), K8_VERSION));
+}
+
+static int32_t k8_get_seq(v8::Local<v8::Value> x, uint8_t **seq, int64_t *len) // data of a Bytes object, an ArrayBuffer or a typed array; return -1 for other types
+{
+	*seq = 0, *len = 0;
+	if (x->IsArrayBuffer()) {
+		*seq = (uint8_t*)x.As<v8::ArrayBuffer>()->Data();
+		*len = x.As<v8::ArrayBuffer>()->ByteLength();
+	} else if (x->IsArrayBufferView()) {
+		v8::Local<v8::ArrayBufferView> v = x.As<v8::ArrayBufferView>();
+		*seq = (uint8_t*)v->Buffer()->Data() + v->ByteOffset();
+		*len = v->ByteLength();
+	} else {
+		k8_bytes_t *a = k8_get_bytes(x);
+		if (a == 0) return -1;
+		*seq = a->buf.s, *len = a->buf.l;
+	}
+	return 0;
+}
+
+static void k8_revcomp(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	if (args.Length() == 0) return;
+	v8::HandleScope handle_scope(args.GetIsolate());
+	const k8_sk_t *sk = k8_sk_get();
+	uint8_t *seq = 0;
+	int64_t len = 0;
+	if (args[0]->IsString()) {
+		len = args[0].As<v8::String>()->Length();
+		seq = (uint8_t*)calloc(len + 1, 1);
+		args[0].As<v8::String>()->WriteOneByte(args.GetIsolate(), seq);
+		sk->revcomp(seq, len);
+		v8::Local<v8::String> str;
+		if (v8::String::NewFromOneByte(args.GetIsolate(), seq, v8::NewStringType::kNormal, len).ToLocal(&str))
+			args.GetReturnValue().Set(str);
+		free(seq);
+	} else if (k8_get_seq(args[0], &seq, &len) == 0 && len > 0) {
+		sk->revcomp(seq, len);
+	}
+}
+
+static uint8_t *k8_get_seq_out(v8::Isolate *isolate, v8::Local<v8::Value> x, int64_t len, const char *func) // a Bytes object is resized to $len; other types must be large enough
+{
+	k8_bytes_t *a = k8_get_bytes(x);
+	uint8_t *s;
+	int64_t l;
+	if (a) {
+		if (len > a->buf.m) K8_GROW(uint8_t, a->buf.s, len - 1, a->buf.m);
+		a->buf.l = len;
+		k8_bytes_sync(isolate, a);
+		return a->buf.s? a->buf.s : (uint8_t*)"";
+	}
+	if (k8_get_seq(x, &s, &l) < 0 || l < len) {
+		char msg[128];
+		snprintf(msg, 128, "[%s] the output must be Bytes or a buffer of at least %lld bytes", func, (long long)len);
+		isolate->ThrowError(v8::String::NewFromUtf8(isolate, msg).ToLocalChecked());
+		return 0;
+	}
+	return s;
+}
+
+static void k8_nt4(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_nt4(seq, out?): A/C/G/T/U to 0/1/2/3 and others to 4
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *seq, *out;
+	int64_t len;
+	if (args.Length() == 0 || k8_get_seq(args[0], &seq, &len) < 0) {
+		isolate->ThrowError("[k8_nt4] the sequence must be Bytes, an ArrayBuffer or a typed array");
+		return;
+	}
+	out = args.Length() > 1 && !args[1]->IsUndefined()? k8_get_seq_out(isolate, args[1], len, "k8_nt4") : seq;
+	if (out == 0) return;
+	k8_sk_get()->nt4(seq, len, out);
+	args.GetReturnValue().Set((double)len);
+}
+
+static void k8_pack2(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_pack2(seq, out): return the number of bases
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *seq, *out;
+	int64_t len;
+	if (args.Length() < 2 || k8_get_seq(args[0], &seq, &len) < 0) {
+		isolate->ThrowError("[k8_pack2] the sequence must be Bytes, an ArrayBuffer or a typed array");
+		return;
+	}
+	if ((out = k8_get_seq_out(isolate, args[1], (len + 3) >> 2, "k8_pack2")) == 0) return;
+	k8_sk_get()->pack2(seq, len, out);
+	args.GetReturnValue().Set((double)len);
+}
+
+static void k8_unpack2(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_unpack2(packed, len, out)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *packed, *out;
+	int64_t l, len = args.Length() > 1? args[1]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+	if (args.Length() < 3 || len < 0 || (out = k8_get_seq_out(isolate, args[2], len, "k8_unpack2")) == 0) return;
+	if (k8_get_seq(args[0], &packed, &l) < 0 || l < (len + 3) >> 2) {
+		isolate->ThrowError("[k8_unpack2] the packed sequence is too short");
+		return;
+	}
+	k8_sk_get();
+	k8_sk_unpack2(packed, len, out);
+	args.GetReturnValue().Set((double)len);
+}
+
+static void k8_count_gcn(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_count_gcn(seq): return [#G/C, #N]
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *seq;
+	int64_t len, cnt[2] = {0, 0};
+	if (args.Length() == 0 || k8_get_seq(args[0], &seq, &len) < 0) {
+		isolate->ThrowError("[k8_count_gcn] the sequence must be Bytes, an ArrayBuffer or a typed array");
+		return;
+	}
+	k8_sk_get()->count_gcn(seq, len, cnt);
+	v8::Local<v8::Value> x[2] = { v8::Number::New(isolate, cnt[0]), v8::Number::New(isolate, cnt[1]) };
+	args.GetReturnValue().Set(v8::Array::New(isolate, x, 2));
+}
+
+static void k8_kmer_hash(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_kmer_hash(seq, k, out): return the number of k-mer positions
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	uint8_t *seq;
+	int64_t len;
+	int32_t k = args.Length() > 1? args[1]->Int32Value(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+	if (args.Length() < 3 || k8_get_seq(args[0], &seq, &len) < 0 || k <= 0 || k > 32 || !args[2]->IsBigUint64Array()) {
+		isolate->ThrowError("[k8_kmer_hash] the arguments must be a sequence, k in [1,32] and a BigUint64Array");
+		return;
+	}
+	v8::Local<v8::TypedArray> ta = args[2].As<v8::TypedArray>();
+	uint64_t *out = (uint64_t*)((uint8_t*)ta->Buffer()->Data() + ta->ByteOffset());
+	int64_t n = k8_sk_kmer(k8_sk_get(), seq, len, k, out, ta->Length());
+	args.GetReturnValue().Set((double)n);
+}
+
+/***********************
+ *** The Bytes class ***
+ ***********************/
+
+static void k8_bytes_free(v8::Isolate *isolate, k8_bytes_t *a)
+{
+	if (a->ref) {
+		a->ref->Reset();
+		delete a->ref;
+	}
+	isolate->AdjustAmountOfExternalAllocatedMemory(-a->n_ext);
+	free(a->buf.s); free(a);
+}
+
+static void k8_bytes_gc_cb2(const v8::WeakCallbackInfo<k8_bytes_t> &info) { k8_bytes_free(info.GetIsolate(), info.GetParameter()); }
+
+static void k8_bytes_gc_cb(const v8::WeakCallbackInfo<k8_bytes_t> &info) // V8 APIs can't be called in the first pass except Reset()
+{
+	k8_bytes_t *a = info.GetParameter();
+	a->ref->Reset();
+	delete a->ref;
+	a->ref = 0;
+	info.SetSecondPassCallback(k8_bytes_gc_cb2);
+}
+
+static void k8_bytes_track(v8::Isolate *isolate, v8::Local<v8::Object> obj, k8_bytes_t *a) // free $a when $obj is garbage collected
+{
+	if (!k8_making_snapshot) { // global handles can't be serialized
+		a->ref = new v8::Global<v8::Object>(isolate, obj);
+		a->ref->SetWeak(a, k8_bytes_gc_cb, v8::WeakCallbackType::kParameter);
+	}
+	k8_bytes_sync(isolate, a);
+}
+
+static void k8_bytes_new(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bytes_t *a = K8_CALLOC(k8_bytes_t, 1);
+	a->magic = K8_BYTES_MAGIC;
+	if (args.Length()) {
+		a->buf.m = a->buf.l = args[0]->IntegerValue(args.GetIsolate()->GetCurrentContext()).FromMaybe(0);
+		a->buf.s = K8_CALLOC(uint8_t, a->buf.l);
+	}
+	K8_SAVE_PTR(args, 0, a);
+	k8_bytes_track(args.GetIsolate(), args.This(), a);
+}
+
+static void k8_bytes_destroy(const v8::FunctionCallbackInfo<v8::Value> &args) // optional as Bytes are freed on garbage collection
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	k8_bytes_free(args.GetIsolate(), a);
+	K8_SAVE_PTR(args, 0, 0);
+	args.GetReturnValue().Set(0);
+}
+
+static void k8_bytes_set(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0 || args.Length() == 0) return;
+	int64_t pre = a->buf.l;
+	int64_t off = args.Length() >= 2? args[1]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(a->buf.l) : a->buf.l;
+	if (args[0]->IsNumber()) {
+		K8_GROW0(uint8_t, a->buf.s, off, a->buf.m);
+		a->buf.s[off] = (uint8_t)args[0]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
+		a->buf.l = off + 1;
+	} else if (args[0]->IsString()) {
+		int32_t len = args[0].As<v8::String>()->Length();
+		K8_GROW0(uint8_t, a->buf.s, off + len, a->buf.m);
+		args[0].As<v8::String>()->WriteOneByte(isolate, &a->buf.s[off]);
+		a->buf.l = off + len;
+	} else if (args[0]->IsArray()) {
+		v8::Handle<v8::Array> array = v8::Handle<v8::Array>::Cast(args[0]);
+		K8_GROW0(uint8_t, a->buf.s, off + array->Length(), a->buf.m);
+		for (size_t i = 0; i < array->Length(); ++i) {
+			v8::Local<v8::Value> x;
+			if (array->Get(isolate->GetCurrentContext(), i).ToLocal(&x))
+				a->buf.s[off++] = (uint8_t)x->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
+		}
+		a->buf.l = off;
+	} else if (args[0]->IsArrayBuffer()) {
+		void *data = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
+		int64_t len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
+		K8_GROW0(uint8_t, a->buf.s, off + len, a->buf.m);
+		memcpy(&a->buf.s[off], data, len);
+		a->buf.l = off + len;
+	} else {
+		isolate->ThrowError("[k8_bytes_set] unsupported type");
+	}
+	k8_bytes_sync(isolate, a);
+	args.GetReturnValue().Set((int32_t)(a->buf.l - pre));
+}
+
+static inline int32_t k8_is_sep(int32_t sep, uint8_t c) // test if $c is a delimiter under the KS_SEP_* conventions
+{
+	if (sep == KS_SEP_TAB) return c == '\t' || c == '\n';
+	else if (sep == KS_SEP_SPACE) return c == ' ' || c == '\t' || c == '\n';
+	else if (sep == KS_SEP_LINE) return c == '\n';
+	return c == sep;
+}
+
+static int32_t k8_get_sep(v8::Isolate *isolate, v8::Local<v8::Value> x, int32_t def) // a KS_SEP_* number or the first character of a string
+{
+	if (x->IsString()) { // not String::Utf8Value as this is called per line by readline()
+		uint8_t c = 0;
+		if (x.As<v8::String>()->Length() > 0) x.As<v8::String>()->WriteOneByte(isolate, &c, 0, 1, v8::String::NO_NULL_TERMINATION);
+		return c? c : def;
+	} else if (x->IsInt32()) {
+		return x->Int32Value(isolate->GetCurrentContext()).FromMaybe(def);
+	}
+	return def;
+}
+
+static void k8_bytes_get_range(const v8::FunctionCallbackInfo<v8::Value> &args, int32_t i, const k8_bytes_t *a, int64_t *st, int64_t *en) // optional [start,end) at args[i] and args[i+1]
+{
+	v8::Local<v8::Context> ctx = args.GetIsolate()->GetCurrentContext();
+	*st = args.Length() > i? args[i]->IntegerValue(ctx).FromMaybe(0) : 0;
+	*en = args.Length() > i + 1? args[i+1]->IntegerValue(ctx).FromMaybe(a->buf.l) : a->buf.l;
+	if (*en > a->buf.l) *en = a->buf.l;
+	if (*st < 0) *st = 0;
+	if (*st > *en) *st = *en;
+}
+
+static void k8_bytes_toString(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t st, en;
+	k8_bytes_get_range(args, 0, a, &st, &en);
+	int32_t ext = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "external", 0) : 0;
+	v8::Local<v8::String> str;
+	if (k8_new_string(isolate, a->buf.s? a->buf.s + st : (uint8_t*)"", en - st, 0, ext, 0).ToLocal(&str))
+		args.GetReturnValue().Set(str);
+}
+
+static void k8_bytes_intern(const v8::FunctionCallbackInfo<v8::Value> &args) // intern(start?, end?): an internalized string; no allocation if the string exists
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t st, en;
+	k8_bytes_get_range(args, 0, a, &st, &en);
+	v8::Local<v8::String> str;
+	if (v8::String::NewFromOneByte(isolate, a->buf.s? a->buf.s + st : (uint8_t*)"", v8::NewStringType::kInternalized, en - st).ToLocal(&str))
+		args.GetReturnValue().Set(str);
+}
+
+static void k8_bytes_fields(const v8::FunctionCallbackInfo<v8::Value> &args) // fields(sep, out, start?, end?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	if (args.Length() < 2 || !(args[1]->IsInt32Array() || args[1]->IsFloat64Array())) {
+		isolate->ThrowError("[k8_bytes_fields] the second argument must be an Int32Array or a Float64Array");
+		return;
+	}
+	int32_t sep = k8_get_sep(isolate, args[0], KS_SEP_TAB);
+	v8::Local<v8::TypedArray> ta = args[1].As<v8::TypedArray>();
+	int32_t is_i32 = args[1]->IsInt32Array();
+	void *off = (uint8_t*)ta->Buffer()->GetBackingStore()->Data() + ta->ByteOffset();
+	int64_t st, en, i, j, n = 0, max = ta->Length() / 2;
+	k8_bytes_get_range(args, 2, a, &st, &en);
+	for (i = j = st; i <= en && n < max; ++i) {
+		if (i == en || k8_is_sep(sep, a->buf.s[i])) {
+			if (is_i32) ((int32_t*)off)[n<<1] = j, ((int32_t*)off)[n<<1|1] = i;
+			else ((double*)off)[n<<1] = j, ((double*)off)[n<<1|1] = i;
+			++n, j = i + 1;
+		}
+	}
+	args.GetReturnValue().Set((double)n);
+}
+
+static void k8_bytes_field(const v8::FunctionCallbackInfo<v8::Value> &args) // field(i, sep?, start?, end?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0 || args.Length() == 0) return;
+	int64_t k = args[0]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(0), st, en, i, j, n = 0;
+	int32_t sep = args.Length() >= 2? k8_get_sep(isolate, args[1], KS_SEP_TAB) : KS_SEP_TAB;
+	k8_bytes_get_range(args, 2, a, &st, &en);
+	for (i = j = st; i <= en; ++i) {
+		if (i == en || k8_is_sep(sep, a->buf.s[i])) {
+			if (n++ == k) {
+				v8::Local<v8::String> str;
+				if (v8::String::NewFromOneByte(isolate, &a->buf.s[j], v8::NewStringType::kNormal, i - j).ToLocal(&str))
+					args.GetReturnValue().Set(str);
+				return;
+			}
+			j = i + 1;
+		}
+	}
+}
+
+static double k8_parse_int(const uint8_t *p, const uint8_t *end) // similar to parseInt() in base 10; NaN if there are no digits
+{
+	double x = 0.0;
+	int32_t neg = 0;
+	const uint8_t *q;
+	while (p < end && isspace(*p)) ++p;
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+	for (q = p; p < end && *p >= '0' && *p <= '9'; ++p)
+		x = x * 10.0 + (*p - '0');
+	if (p == q) return NAN;
+	if (p - q > 15 && p - q < 512) { // $x may be inexact; round correctly with strtod()
+		char buf[512];
+		memcpy(buf, q, p - q);
+		buf[p - q] = 0;
+		x = strtod(buf, 0);
+	}
+	return neg? -x : x;
+}
+
+static double k8_parse_float(const uint8_t *p, const uint8_t *end) // similar to parseFloat(); NaN if there is no number
+{
+	static const double pow10[] = { 1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22 };
+	const uint8_t *st, *q;
+	uint64_t m = 0;
+	int32_t neg = 0, n_dig = 0, n_sig = 0, e = 0;
+	while (p < end && isspace(*p)) ++p;
+	st = p;
+	if (p < end && (*p == '-' || *p == '+')) neg = (*p++ == '-');
+	if (end - p >= 8 && strncmp((const char*)p, "Infinity", 8) == 0) return neg? -INFINITY : INFINITY;
+	for (; p < end && *p >= '0' && *p <= '9'; ++p, ++n_dig) // integer part
+		if (m || *p != '0') { // $n_sig counts significant digits
+			if (n_sig++ < 19) m = m * 10 + (*p - '0');
+			else ++e;
+		}
+	if (p < end && *p == '.') { // fractional part
+		for (++p; p < end && *p >= '0' && *p <= '9'; ++p, ++n_dig) {
+			if (m || *p != '0') {
+				if (n_sig++ < 19) m = m * 10 + (*p - '0'), --e;
+			} else --e;
+		}
+	}
+	if (n_dig == 0) return NAN;
+	if (p < end && (*p == 'e' || *p == 'E')) { // exponent; ignored if not followed by digits
+		int32_t neg_e = 0, x = 0;
+		q = p + 1;
+		if (q < end && (*q == '-' || *q == '+')) neg_e = (*q++ == '-');
+		if (q < end && *q >= '0' && *q <= '9') {
+			for (; q < end && *q >= '0' && *q <= '9'; ++q)
+				if (x < 100000) x = x * 10 + (*q - '0');
+			e += neg_e? -x : x, p = q;
+		}
+	}
+	if (n_sig <= 19 && m < (1ULL<<53) && e >= -22 && e <= 22) { // exact; the Clinger fast path
+		double x = e >= 0? (double)m * pow10[e] : (double)m / pow10[-e];
+		return neg? -x : x;
+	} else { // fall back to strtod(); [st,p) has been validated above
+		char tmp[512], *buf = p - st < (int64_t)sizeof(tmp)? tmp : K8_MALLOC(char, p - st + 1); // long with many leading or trailing zeros
+		double x;
+		memcpy(buf, st, p - st);
+		buf[p - st] = 0;
+		x = strtod(buf, 0);
+		if (buf != tmp) free(buf);
+		return x;
+	}
+}
+
+static void k8_bytes_parseInt(const v8::FunctionCallbackInfo<v8::Value> &args) // parseInt(start?, end?)
+{
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t st, en;
+	k8_bytes_get_range(args, 0, a, &st, &en);
+	args.GetReturnValue().Set(k8_parse_int(a->buf.s + st, a->buf.s + en));
+}
+
+static void k8_bytes_parseFloat(const v8::FunctionCallbackInfo<v8::Value> &args) // parseFloat(start?, end?)
+{
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t st, en;
+	k8_bytes_get_range(args, 0, a, &st, &en);
+	args.GetReturnValue().Set(k8_parse_float(a->buf.s + st, a->buf.s + en));
+}
+
+static void k8_bytes_parseColumn(const v8::FunctionCallbackInfo<v8::Value> &args) // parseColumn(col, sep, out, offsets?, n?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
+	if (a == 0) return;
+	if (args.Length() < 3 || !args[2]->IsFloat64Array()) {
+		isolate->ThrowError("[k8_bytes_parseColumn] the third argument must be a Float64Array");
+		return;
+	}
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	int64_t col = args[0]->IntegerValue(ctx).FromMaybe(0), n = 0, max, n_lines = -1;
+	int32_t sep = k8_get_sep(isolate, args[1], KS_SEP_TAB);
+	v8::Local<v8::TypedArray> ta = args[2].As<v8::TypedArray>();
+	double *out = (double*)((uint8_t*)ta->Buffer()->GetBackingStore()->Data() + ta->ByteOffset());
+	void *off = 0;
+	int32_t is_i32 = 0;
+	max = ta->Length();
+	if (args.Length() >= 4 && (args[3]->IsInt32Array() || args[3]->IsFloat64Array())) { // lines given by offsets, as from File.prototype.readlines()
+		v8::Local<v8::TypedArray> to = args[3].As<v8::TypedArray>();
+		is_i32 = args[3]->IsInt32Array();
+		off = (uint8_t*)to->Buffer()->GetBackingStore()->Data() + to->ByteOffset();
+		n_lines = to->Length() / 2;
+		if (args.Length() >= 5) {
+			int64_t x = args[4]->IntegerValue(ctx).FromMaybe(n_lines);
+			if (x < n_lines) n_lines = x;
+		}
+		if (n_lines < max) max = n_lines;
+	}
+	for (int64_t pos = 0; n < max && (off || pos < a->buf.l); ++n) {
+		int64_t st, en, i, j, k = 0;
+		if (off) {
+			st = is_i32? ((int32_t*)off)[n<<1] : (int64_t)((double*)off)[n<<1];
+			en = is_i32? ((int32_t*)off)[n<<1|1] : (int64_t)((double*)off)[n<<1|1];
+			if (en > a->buf.l) en = a->buf.l;
+			if (st < 0 || st > en) st = en;
+		} else { // lines separated by newlines
+			uint8_t *q = (uint8_t*)memchr(a->buf.s + pos, '\n', a->buf.l - pos);
+			st = pos, en = q? q - a->buf.s : a->buf.l;
+			pos = en + 1;
+		}
+		out[n] = NAN;
+		for (i = j = st; i <= en; ++i) {
+			if (i == en || k8_is_sep(sep, a->buf.s[i])) {
+				if (k++ == col) {
+					out[n] = k8_parse_float(a->buf.s + j, a->buf.s + i);
+					break;
+				}
+				j = i + 1;
+			}
+		}
+	}
+	args.GetReturnValue().Set((double)n);
+}
+
+static void k8_bytes_length_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
+	if (a == 0) return;
+	info.GetReturnValue().Set((int32_t)a->buf.l);
+}
+
+static void k8_bytes_length_setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t len = value->IntegerValue(info.GetIsolate()->GetCurrentContext()).FromMaybe(a->buf.l);
+	if (len > a->buf.m) K8_GROW0(uint8_t, a->buf.s, len - 1, a->buf.m);
+	a->buf.l = len;
+	k8_bytes_sync(info.GetIsolate(), a);
+}
+
+static void k8_bytes_capacity_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
+	if (a == 0) return;
+	info.GetReturnValue().Set((int32_t)a->buf.m);
+}
+
+static void k8_bytes_capacity_setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
+	if (a == 0) return;
+	int64_t len = value->IntegerValue(info.GetIsolate()->GetCurrentContext()).FromMaybe(a->buf.m);
+	if (len < a->buf.l) len = a->buf.l;
+	a->buf.m = len;
+	a->buf.s = K8_REALLOC(uint8_t, a->buf.s, a->buf.m);
+	k8_bytes_sync(info.GetIsolate(), a);
+}
+
+static void k8_ext_delete_cb(void *data, size_t len, void *aux) {} // do nothing
+
+static void k8_bytes_buffer_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
+	if (a == 0) return;
+	v8::Local<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(info.GetIsolate(), v8::ArrayBuffer::NewBackingStore((uint8_t*)a->buf.s, a->buf.l, k8_ext_delete_cb, 0));
+	v8::Local<v8::Private> key = v8::Private::ForApi(info.GetIsolate(), v8::String::NewFromUtf8Literal(info.GetIsolate(), "k8_owner"));
+	ab->SetPrivate(info.GetIsolate()->GetCurrentContext(), key, info.This()).FromJust(); // so that $a is not freed while the ArrayBuffer is reachable
+	info.GetReturnValue().Set(ab);
+}
+
+/**********************
+ *** The File class ***
+ **********************/
+
+static void k8_file_free(v8::Isolate *isolate, k8_file_t *ks)
+{
+	if (ks->ref) {
+		ks->ref->Reset();
+		delete ks->ref;
+	}
+	isolate->AdjustAmountOfExternalAllocatedMemory(-ks->n_ext);
+	ks_close(ks);
+}
+
+static void k8_file_gc_cb2(const v8::WeakCallbackInfo<k8_file_t> &info)
+{
+	k8_file_t *ks = info.GetParameter();
+	if (ks->fpw == stdout) ks->fpw = 0; // don't close stdout for a File opened with "-"
+	k8_file_free(info.GetIsolate(), ks);
+	fflush(stdout);
+}
+
+static void k8_file_gc_cb(const v8::WeakCallbackInfo<k8_file_t> &info)
+{
+	k8_file_t *ks = info.GetParameter();
+	ks->ref->Reset();
+	delete ks->ref;
+	ks->ref = 0;
+	info.SetSecondPassCallback(k8_file_gc_cb2);
+}
+
+static void k8_file_open(const v8::FunctionCallbackInfo<v8::Value> &args) // File(fn|fd?, mode?, opt?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = 0;
+	int fd = args.Length() >= 1 && args[0]->IsUint32()? args[0]->Int32Value(isolate->GetCurrentContext()).FromMaybe(-1) : -1;
+	int32_t n_threads = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "threads", 0) : 0;
+	int32_t level = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "level", -1) : -1;
+	int32_t out_size = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "buffer", -1) : -1;
+	if (args.Length() >= 2) { // File(fn, mode) or File(fd, mode)
+		v8::String::Utf8Value mode(isolate, args[1]);
+		if (fd >= 0) { // File(fd, mode)
+			ks = ks_open(fd, 0, *mode, n_threads, level);
+		} else { // File(fn, mode)
+			v8::String::Utf8Value fn(isolate, args[0]);
+			ks = ks_open(-1, *fn, *mode, n_threads, level);
+		}
+	} else if (args.Length() == 1) { // File(fn) or File(fd)
+		if (fd >= 0) {
+			ks = ks_open(fd, 0, 0, 0, -1);
+		} else {
+			v8::String::Utf8Value fn(isolate, args[0]);
+			ks = ks_open(-1, *fn, 0, 0, -1);
+		}
+	} else { // File()
+		ks = ks_open(0, 0, 0, 0, -1); // open stdin for reading
+	}
+	if (ks) {
+		K8_SAVE_PTR(args, 0, ks);
+		if (ks->fpw && out_size >= 0) { // the stdout buffer is shared, so its size is set here, too
+			k8_file_t *o = ks->fpw == stdout && ks->zw == 0? ks_std(0) : ks;
+			ks_flush(o);
+			o->out_size = out_size;
+			if (out_size == 0) o->out_sync = 1;
+		}
+		if (!k8_making_snapshot) { // close the file on garbage collection
+			ks->ref = new v8::Global<v8::Object>(isolate, args.This());
+			ks->ref->SetWeak(ks, k8_file_gc_cb, v8::WeakCallbackType::kParameter);
+		}
+		ks->n_ext = ks_mem(ks);
+		isolate->AdjustAmountOfExternalAllocatedMemory(ks->n_ext);
+	} else {
+		isolate->ThrowError("k8_open: failed to open file");
+		args.GetReturnValue().SetNull();
+	}
+}
+
+static void k8_file_close(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	k8_file_free(args.GetIsolate(), ks);
+	K8_SAVE_PTR(args, 0, 0);
+	args.GetReturnValue().Set(0);
+}
+
+static int32_t k8_get_sep_off(const v8::FunctionCallbackInfo<v8::Value> &args, int32_t *sep)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	*sep = args.Length() >= 2? k8_get_sep(isolate, args[1], KS_SEP_LINE) : KS_SEP_LINE;
+	return args.Length() >= 3? args[2]->Int32Value(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+}
+
+static void k8_file_readline(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	if (!args.Length() || !args[0]->IsObject()) {
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	v8::Handle<v8::Object> b = v8::Handle<v8::Object>::Cast(args[0]);
+	k8_bytes_t *a = (k8_bytes_t*)b->GetAlignedPointerFromInternalField(0); // not k8_get_bytes() as this is performance critical
+	if (a == 0 || a->magic != K8_BYTES_MAGIC) {
+		args.GetReturnValue().Set(-2);
+	} else {
+		int32_t dret, sep, n = args[1]->IsString()? args[1].As<v8::String>()->Length() : 0;
+		int64_t ret;
+		if (n > 1) { // a set of delimiters; the last set is cached
+			uint8_t c[K8_BSET_MAX];
+			if (n > K8_BSET_MAX) {
+				args.GetReturnValue().Set(-2);
+				return;
+			}
+			args[1].As<v8::String>()->WriteOneByte(isolate, c, 0, n, v8::String::NO_NULL_TERMINATION);
+			if (n != ks->n_sep || memcmp(c, ks->sep_str, n) != 0) {
+				k8_bset_init(&ks->sep, c, n);
+				memcpy(ks->sep_str, c, n);
+				ks->n_sep = n;
+			}
+			a->buf.l = args.Length() >= 3? args[2]->Int32Value(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+			ret = ks_getuntil_set(ks, &ks->sep, 0, &a->buf, &dret, 1);
+		} else {
+			a->buf.l = k8_get_sep_off(args, &sep);
+			ret = ks_getuntil2(ks, sep, &a->buf, &dret, 1);
+		}
+		k8_bytes_sync(isolate, a);
+		if (ret >= 0) args.GetReturnValue().Set(dret), ++ks->stat.n_line;
+		else args.GetReturnValue().Set((int32_t)ret);
+	}
+}
+
+static void k8_file_readlines(const v8::FunctionCallbackInfo<v8::Value> &args) // readlines(buf, maxLines, offsets)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	k8_bytes_t *a = args.Length() >= 3? k8_get_bytes(args[0]) : 0;
+	if (a == 0 || !(args[2]->IsInt32Array() || args[2]->IsFloat64Array())) {
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	v8::Local<v8::TypedArray> ta = args[2].As<v8::TypedArray>();
+	int32_t is_i32 = args[2]->IsInt32Array();
+	void *off = (uint8_t*)ta->Buffer()->GetBackingStore()->Data() + ta->ByteOffset();
+	int64_t max = args[1]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(0), n = 0, ret = 0;
+	if (max > (int64_t)ta->Length() / 2) max = ta->Length() / 2; // each line takes two elements: start and end
+	a->buf.l = 0;
+	while (n < max) {
+		int64_t st = a->buf.l;
+		if (is_i32 && st > INT32_MAX>>1) break; // end the batch early so that the offsets of the next line are likely to fit
+		if ((ret = ks_getuntil2(ks, KS_SEP_LINE, &a->buf, 0, 1)) < 0) break;
+		if (is_i32 && a->buf.l > INT32_MAX) { // the line has been consumed and can't be returned
+			n = 0, ret = -2;
+			break;
+		}
+		if (is_i32) ((int32_t*)off)[n<<1] = st, ((int32_t*)off)[n<<1|1] = a->buf.l;
+		else ((double*)off)[n<<1] = st, ((double*)off)[n<<1|1] = a->buf.l;
+		++n;
+	}
+	ks->stat.n_line += n;
+	k8_bytes_sync(isolate, a);
+	if (n > 0 || max <= 0) args.GetReturnValue().Set((double)n);
+	else args.GetReturnValue().Set((int32_t)ret); // -1 on EOF or <-1 on errors
+}
+
+static void k8_file_read(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	if (args.Length() == 0) { // prototype.read()
+		int32_t c = ks_getc(ks);
+		args.GetReturnValue().Set(c);
+	} else if (args.Length() >= 1 && args[0]->IsObject()) {
+		v8::Handle<v8::Object> b = v8::Handle<v8::Object>::Cast(args[0]);
+		k8_bytes_t *a = (k8_bytes_t*)b->GetAlignedPointerFromInternalField(0);
+		if (a == 0 || a->magic != K8_BYTES_MAGIC) { // TODO: well, there got to be a better way
+			args.GetReturnValue().Set(-2);
+			return;
+		}
+		uint32_t off = a->buf.l;
+		if (args.Length() >= 2 && args[1]->IsUint32())
+			off = args[1]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
+		if (args.Length() == 3 && args[1]->IsUint32() && args[2]->IsUint32()) { // prototype.read(bytes, off, len)
+			uint32_t len = args[2]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
+			K8_GROW(uint8_t, a->buf.s, off + len - 1, a->buf.m);
+			int64_t ret = ks_read(ks, &a->buf.s[off], len);
+			if (ret > 0 && a->buf.l < off + ret) a->buf.l = off + ret;
+			k8_bytes_sync(isolate, a);
+			args.GetReturnValue().Set((int32_t)ret);
+		} else if (args.Length() == 1 || (args.Length() == 2 && args[1]->IsUint32())) { // prototype.read(bytes) or prototype.read(bytes, off)
+			int64_t ret = ks_read_all_at(ks, &a->buf, off); // directly into $bytes
+			k8_bytes_sync(isolate, a);
+			args.GetReturnValue().Set((int32_t)ret);
+		}
+	}
+}
+
+static void k8_file_readFastx(const v8::FunctionCallbackInfo<v8::Value> &args) // readFastx(name, seq, qual?, comment?)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	k8_bytes_t *a[4];
+	kstring_t qual = {0,0,0}, comment = {0,0,0}; // used when qual or comment is not requested
+	for (int32_t i = 0; i < 4; ++i)
+		a[i] = i < args.Length()? k8_get_bytes(args[i]) : 0;
+	if (a[0] == 0 || a[1] == 0) { // name and seq are required
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	int64_t ret = ks_read_fastx(ks, &a[0]->buf, &a[1]->buf, a[2]? &a[2]->buf : &qual, a[3]? &a[3]->buf : &comment);
+	if (ret >= 0) ++ks->stat.n_rec;
+	free(qual.s); free(comment.s);
+	for (int32_t i = 0; i < 4; ++i)
+		if (a[i]) k8_bytes_sync(args.GetIsolate(), a[i]);
+	args.GetReturnValue().Set((double)ret);
+}
+
+static void k8_file_write(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	if (ks->magic != K8_FILE_MAGIC || ks->fpw == 0) {
+		args.GetReturnValue().Set(-1);
+		return;
+	}
+	if (ks->fpw == stdout && ks->zw == 0) ks = ks_std(0); // share the buffer with print()
+	if (args[0]->IsArrayBuffer()) {
+		void *data = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
+		int64_t len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
+		assert(len >= 0 && len < INT32_MAX);
+		args.GetReturnValue().Set((int32_t)ks_write(ks, (uint8_t*)data, len));
+	} else if (args[0]->IsString()) {
+		int32_t len = args[0].As<v8::String>()->Length();
+		args[0].As<v8::String>()->WriteOneByte(args.GetIsolate(), ks_reserve(ks, len), 0, len, v8::String::NO_NULL_TERMINATION);
+		ks->out.l += len;
+		args.GetReturnValue().Set(len);
+	}
+	if (ks->out_sync) ks_flush(ks);
+}
+
+static void k8_file_flush(const v8::FunctionCallbackInfo<v8::Value> &args) // flush(): write out buffered data
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0 || ks->fpw == 0) {
+		args.GetReturnValue().Set(-1);
+		return;
+	}
+	if (ks->fpw == stdout && ks->zw == 0) ks = ks_std(0);
+	args.GetReturnValue().Set(ks_flush_all(ks));
+}
+
+static void k8_file_tell(const v8::FunctionCallbackInfo<v8::Value> &args) // tell(): virtual offset for BGZF and uncompressed offset otherwise
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	args.GetReturnValue().Set((double)ks_tell(ks));
+}
+
+static void k8_file_seek(const v8::FunctionCallbackInfo<v8::Value> &args) // seek(off)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	if (args.Length() == 0 || !args[0]->IsNumber()) {
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	args.GetReturnValue().Set(ks_seek(ks, args[0]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(-1)));
+}
+
+static void k8_file_readRange(const v8::FunctionCallbackInfo<v8::Value> &args) // readRange(start, end, buf): read uncompressed bytes in [start,end)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	k8_bytes_t *a = args.Length() >= 3? k8_get_bytes(args[2]) : 0;
+	int64_t st = args.Length() >= 2? args[0]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(-1) : -1;
+	int64_t en = args.Length() >= 2? args[1]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(-1) : -1;
+	int64_t ret;
+	if (a == 0 || st < 0 || en < st || en - st > INT32_MAX) {
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	if (ks->bz && ks_gzi_index(ks, 0) < 0) ret = -3; // the index is loaded or built on the first call
+	else if ((ret = ks_useek(ks, st)) == 0) {
+		K8_GROW(uint8_t, a->buf.s, en - st, a->buf.m);
+		ret = ks_read(ks, a->buf.s, en - st);
+		a->buf.l = ret > 0? ret : 0;
+		k8_bytes_sync(isolate, a);
+	}
+	args.GetReturnValue().Set((double)ret);
+}
+
+static void k8_file_index(const v8::FunctionCallbackInfo<v8::Value> &args, int32_t save) // loadIndex(fn?) and saveIndex(fn?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	v8::String::Utf8Value str(isolate, args[0]);
+	const char *fn = args.Length() > 0 && args[0]->IsString()? *str : 0;
+	int64_t ret = ks_gzi_index(ks, save? 0 : fn); // saveIndex() never reads $fn
+	if (ret >= 0 && save) {
+		char path[K8_PATH_MAX+1];
+		if (fn == 0) snprintf(path, K8_PATH_MAX + 1, "%s.gzi", ks->fn), fn = path;
+		if (ks_gzi_save(fn, ks->gzi, ks->n_gzi) < 0) ret = -3;
+	}
+	args.GetReturnValue().Set((double)ret);
+}
+
+static void k8_file_loadIndex(const v8::FunctionCallbackInfo<v8::Value> &args) { k8_file_index(args, 0); }
+static void k8_file_saveIndex(const v8::FunctionCallbackInfo<v8::Value> &args) { k8_file_index(args, 1); }
+
+static void k8_file_stats(const v8::FunctionCallbackInfo<v8::Value> &args) // stats(): I/O statistics as an object
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
+	if (ks == 0) return;
+	if (ks->fpw == stdout && ks->zw == 0) ks = ks_std(0); // print() and File("-", "w") write to the same buffer
+	ks_stat_sync(ks);
+	const ks_stat_t *t = &ks->stat;
+	const char *key[] = { "bytesIn", "bytesOut", "compressedIn", "compressedOut", "fills", "flushes", "lines", "records", "fillTime", "flushTime" };
+	double val[] = { (double)t->n_in, (double)t->n_out, (double)t->z_in, (double)t->z_out, (double)t->n_fill, (double)t->n_flush, (double)t->n_line, (double)t->n_rec, t->t_fill, t->t_flush };
+	v8::Local<v8::Object> ret = v8::Object::New(isolate);
+	for (int32_t i = 0; i < 10; ++i)
+		ret->Set(ctx, v8::String::NewFromUtf8(isolate, key[i]).ToLocalChecked(), v8::Number::New(isolate, val[i])).FromJust();
+	args.GetReturnValue().Set(ret);
+}
+
+/*******************************
+ *** The IntervalIndex class ***
+ *******************************/
+
+#define K8_IIDX_MAGIC (0x496964)
+
+typedef struct {
+	int64_t st, en, max, id; // max: the max end in the subtree
+} k8_iv_t;
+
+typedef struct { // implicit interval tree; modified from cgranges
+	uint64_t magic;
+	int64_t n, m;
+	int32_t max_level, indexed;
+	k8_iv_t *a;
+	int64_t m_b, *b; // buffer for overlap()
+	int64_t n_ext; // memory reported to V8
+	v8::Global<v8::Object> *ref;
+} k8_iidx_t;
+
+static void k8_iv_sort(k8_iv_t *a, int64_t n) // LSD radix sort by start; passes with a single bucket are skipped
+{
+	k8_iv_t *b, *src = a, *dst;
+	int64_t i, *cnt;
+	if (n < 2) return;
+	b = K8_MALLOC(k8_iv_t, n);
+	cnt = K8_MALLOC(int64_t, 1<<16); // not on the stack, which is small in Worker threads
+	dst = b;
+	for (int32_t shift = 0; shift < 64; shift += 16) {
+		int64_t sum = 0;
+		memset(cnt, 0, (1<<16) * sizeof(int64_t));
+		for (i = 0; i < n; ++i) ++cnt[((uint64_t)src[i].st ^ 1ULL<<63) >> shift & 0xffff]; // flip the sign bit for negative starts
+		if (cnt[((uint64_t)src[0].st ^ 1ULL<<63) >> shift & 0xffff] == n) continue;
+		for (i = 0; i < 1<<16; ++i) {
+			int64_t c = cnt[i];
+			cnt[i] = sum, sum += c;
+		}
+		for (i = 0; i < n; ++i) dst[cnt[((uint64_t)src[i].st ^ 1ULL<<63) >> shift & 0xffff]++] = src[i];
+		k8_iv_t *t = src; src = dst, dst = t;
+	}
+	if (src != a) memcpy(a, src, n * sizeof(k8_iv_t));
+	free(b); free(cnt);
+}
+
+static int32_t k8_iidx_index(k8_iidx_t *t) // sort and compute max; return the max level
+{
+	k8_iv_t *a = t->a;
+	int64_t i, n = t->n, last_i = 0, last = 0;
+	int32_t k;
+	k8_iv_sort(a, n);
+	t->indexed = 1;
+	if (n == 0) return t->max_level = -1;
+	for (i = 0; i < n; i += 2) last_i = i, last = a[i].max = a[i].en; // leaves (i.e. at level 0)
+	for (k = 1; 1LL<<k <= n; ++k) { // process internal nodes in the bottom-up order
+		int64_t x = 1LL<<(k-1), i0 = (x<<1) - 1, step = x<<2;
+		for (i = i0; i < n; i += step) {
+			int64_t el = a[i - x].max; // max end of the left child
+			int64_t er = i + x < n? a[i + x].max : last; // of the right child
+			int64_t e = a[i].en;
+			e = e > el? e : el;
+			e = e > er? e : er;
+			a[i].max = e;
+		}
+		last_i = last_i>>k&1? last_i - x : last_i + x; // last_i now points to the parent of the original last_i
+		if (last_i < n && a[last_i].max > last)
+			last = a[last_i].max;
+	}
+	return t->max_level = k - 1;
+}
+
+static int64_t k8_iidx_overlap(const k8_iidx_t *t, int64_t st, int64_t en, int64_t **b, int64_t *m_b) // indices of intervals overlapping [st,en) in b[], in the sorted order
+{
+	struct { int64_t x; int32_t k, w; } stack[64];
+	const k8_iv_t *a = t->a;
+	int64_t n = t->n, n_b = 0;
+	int32_t p = 0;
+	if (t->max_level < 0) return 0;
+	stack[p].x = (1LL<<t->max_level) - 1, stack[p].k = t->max_level, stack[p++].w = 0; // the root
+	while (p) {
+		int64_t x = stack[--p].x;
+		int32_t k = stack[p].k, w = stack[p].w;
+		if (k <= 3) { // a small subtree: scan linearly
+			int64_t i, i0 = x >> k << k, i1 = i0 + (1LL<<(k+1)) - 1;
+			if (i1 > n) i1 = n;
+			for (i = i0; i < i1 && a[i].st < en; ++i)
+				if (st < a[i].en) {
+					K8_GROW(int64_t, *b, n_b, *m_b);
+					(*b)[n_b++] = i;
+				}
+		} else if (w == 0) { // the left child not processed
+			int64_t y = x - (1LL<<(k-1)); // the left child; it may be out of range
+			stack[p].x = x, stack[p].k = k, stack[p++].w = 1;
+			if (y >= n || a[y].max > st)
+				stack[p].x = y, stack[p].k = k - 1, stack[p++].w = 0;
+		} else if (x < n && a[x].st < en) {
+			if (st < a[x].en) {
+				K8_GROW(int64_t, *b, n_b, *m_b);
+				(*b)[n_b++] = x;
+			}
+			stack[p].x = x + (1LL<<(k-1)), stack[p].k = k - 1, stack[p++].w = 0; // the right child
+		}
+	}
+	return n_b;
+}
+
+static inline void k8_iidx_sync(v8::Isolate *isolate, k8_iidx_t *t)
+{
+	int64_t x = t->m * sizeof(k8_iv_t);
+	if (x != t->n_ext) {
+		isolate->AdjustAmountOfExternalAllocatedMemory(x - t->n_ext);
+		t->n_ext = x;
+	}
+}
+
+static void k8_iidx_gc_cb2(const v8::WeakCallbackInfo<k8_iidx_t> &info)
+{
+	k8_iidx_t *t = info.GetParameter();
+	info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(-t->n_ext);
+	free(t->a); free(t->b); free(t);
+}
+
+static void k8_iidx_gc_cb(const v8::WeakCallbackInfo<k8_iidx_t> &info)
+{
+	k8_iidx_t *t = info.GetParameter();
+	t->ref->Reset();
+	delete t->ref;
+	t->ref = 0;
+	info.SetSecondPassCallback(k8_iidx_gc_cb2);
+}
+
+static k8_iidx_t *k8_iidx_init(v8::Isolate *isolate, v8::Local<v8::Object> obj)
+{
+	k8_iidx_t *t = K8_CALLOC(k8_iidx_t, 1);
+	t->magic = K8_IIDX_MAGIC;
+	t->max_level = -1;
+	obj->SetAlignedPointerInInternalField(0, t);
+	if (!k8_making_snapshot) {
+		t->ref = new v8::Global<v8::Object>(isolate, obj);
+		t->ref->SetWeak(t, k8_iidx_gc_cb, v8::WeakCallbackType::kParameter);
+	}
+	return t;
+}
+
+static inline void k8_iidx_push(k8_iidx_t *t, int64_t st, int64_t en, int64_t id)
+{
+	K8_GROW(k8_iv_t, t->a, t->n, t->m);
+	t->a[t->n].st = st, t->a[t->n].en = en, t->a[t->n].max = en, t->a[t->n].id = id;
+	++t->n, t->indexed = 0;
+}
+
+static void k8_iidx_new(const v8::FunctionCallbackInfo<v8::Value> &args)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_iidx_init(args.GetIsolate(), args.This());
+}
+
+static void k8_iidx_add(const v8::FunctionCallbackInfo<v8::Value> &args) // add(st, en, id?)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_iidx_t *t = K8_LOAD_PTR(args, 0, k8_iidx_t);
+	if (t == 0 || args.Length() < 2) return;
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	int64_t st = args[0]->IntegerValue(ctx).FromMaybe(0);
+	int64_t en = args[1]->IntegerValue(ctx).FromMaybe(0);
+	int64_t id = args.Length() >= 3? args[2]->IntegerValue(ctx).FromMaybe(t->n) : t->n;
+	k8_iidx_push(t, st, en, id);
+	k8_iidx_sync(isolate, t);
+}
+
+static void k8_iidx_index_js(const v8::FunctionCallbackInfo<v8::Value> &args) // index(): optional as overlap() indexes when needed
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_iidx_t *t = K8_LOAD_PTR(args, 0, k8_iidx_t);
+	if (t == 0) return;
+	args.GetReturnValue().Set(k8_iidx_index(t));
+}
+
+static void k8_iidx_overlap_js(const v8::FunctionCallbackInfo<v8::Value> &args) // overlap(st, en, out)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_iidx_t *t = K8_LOAD_PTR(args, 0, k8_iidx_t);
+	if (t == 0) return;
+	if (args.Length() < 3 || !(args[2]->IsInt32Array() || args[2]->IsFloat64Array())) {
+		isolate->ThrowError("[k8_iidx_overlap] the third argument must be an Int32Array or a Float64Array");
+		return;
+	}
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	int64_t st = args[0]->IntegerValue(ctx).FromMaybe(0);
+	int64_t en = args[1]->IntegerValue(ctx).FromMaybe(0);
+	v8::Local<v8::TypedArray> ta = args[2].As<v8::TypedArray>();
+	int32_t is_i32 = args[2]->IsInt32Array();
+	void *out = (uint8_t*)ta->Buffer()->Data() + ta->ByteOffset();
+	int64_t i, n, max = ta->Length() / 3;
+	if (!t->indexed) k8_iidx_index(t);
+	n = k8_iidx_overlap(t, st, en, &t->b, &t->m_b);
+	for (i = 0; i < n && i < max; ++i) {
+		const k8_iv_t *p = &t->a[t->b[i]];
+		if (is_i32) ((int32_t*)out)[i*3] = p->st, ((int32_t*)out)[i*3+1] = p->en, ((int32_t*)out)[i*3+2] = p->id;
+		else ((double*)out)[i*3] = p->st, ((double*)out)[i*3+1] = p->en, ((double*)out)[i*3+2] = p->id;
+	}
+	args.GetReturnValue().Set((double)n);
+}
+
+static void k8_iidx_length_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_iidx_t *t = K8_LOAD_PTR(info, 0, k8_iidx_t);
+	if (t == 0) return;
+	info.GetReturnValue().Set((double)t->n);
+}
+
+static void k8_iidx_fromBed(const v8::FunctionCallbackInfo<v8::Value> &args) // IntervalIndex.fromBed(file): return {ctg: IntervalIndex}
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	k8_file_t *ks = 0;
+	int32_t to_close = 0;
+	if (args.Length() > 0 && args[0]->IsString()) {
+		v8::String::Utf8Value fn(isolate, args[0]);
+		ks = ks_open(-1, *fn, 0, 0, -1), to_close = 1;
+	} else if (args.Length() > 0 && args[0]->IsObject() && args[0].As<v8::Object>()->InternalFieldCount() > 0) {
+		ks = (k8_file_t*)args[0].As<v8::Object>()->GetAlignedPointerFromInternalField(0);
+		if (ks && (ks->magic != K8_FILE_MAGIC || ks->fpw)) ks = 0;
+	}
+	if (ks == 0) {
+		isolate->ThrowError("[k8_iidx_fromBed] failed to open the file");
+		return;
+	}
+	if (!args.This()->IsFunction()) { // such as "let f = IntervalIndex.fromBed; f(fn)"
+		if (to_close) ks_close(ks);
+		isolate->ThrowError("[k8_iidx_fromBed] must be called as IntervalIndex.fromBed()");
+		return;
+	}
+	v8::Local<v8::Object> ret = v8::Object::New(isolate, v8::Null(isolate), 0, 0, 0); // no prototype, so that contigs such as "toString" are not found in Object.prototype
+	v8::Local<v8::Function> cons = args.This().As<v8::Function>();
+	kstring_t str = {0,0,0}, last = {0,0,0};
+	k8_iidx_t *t = 0;
+	int64_t id = 0;
+	int32_t bad_cons = 0;
+	while (ks_getuntil2(ks, KS_SEP_LINE, &str, 0, 0) >= 0) {
+		int64_t i, j, k, st = 0, en = 0;
+		if (str.l == 0 || str.s[0] == '#' || (str.l >= 5 && strncmp((char*)str.s, "track", 5) == 0) || (str.l >= 7 && strncmp((char*)str.s, "browser", 7) == 0))
+			continue;
+		for (i = j = k = 0; i <= str.l && k < 3; ++i) {
+			if (i < str.l && str.s[i] != '\t') continue;
+			if (k == 0) { // the contig name
+				if (t == 0 || i != last.l || memcmp(last.s, str.s, i) != 0) { // a new contig; BED files are often sorted
+					v8::Local<v8::String> name = v8::String::NewFromOneByte(isolate, str.s, v8::NewStringType::kNormal, i).ToLocalChecked();
+					v8::Local<v8::Value> v = ret->Get(ctx, name).ToLocalChecked();
+					if (v->IsUndefined()) {
+						v8::Local<v8::Object> obj;
+						if (!cons->NewInstance(ctx).ToLocal(&obj) || obj->InternalFieldCount() == 0) break; // "this" is not IntervalIndex
+						ret->Set(ctx, name, obj).FromJust();
+						v = obj;
+					}
+					if (t) k8_iidx_sync(isolate, t);
+					if (!v->IsObject() || v.As<v8::Object>()->InternalFieldCount() == 0) break;
+					t = (k8_iidx_t*)v.As<v8::Object>()->GetAlignedPointerFromInternalField(0);
+					if (t == 0 || t->magic != K8_IIDX_MAGIC) break;
+					last.l = 0;
+					K8_GROW(uint8_t, last.s, i, last.m);
+					memcpy(last.s, str.s, i);
+					last.l = i;
+				}
+			} else {
+				double x = k8_parse_int(&str.s[j], &str.s[i]);
+				if (isnan(x)) break;
+				if (k == 1) st = (int64_t)x;
+				else en = (int64_t)x;
+			}
+			++k, j = i + 1;
+		}
+		if (k == 0) { // the constructor is not IntervalIndex
+			bad_cons = 1, t = 0;
+			break;
+		}
+		if (k < 3) continue; // fewer than three columns or not a number
+		k8_iidx_push(t, st, en, id++);
+	}
+	if (t) k8_iidx_sync(isolate, t);
+	free(str.s); free(last.s);
+	if (to_close) ks_close(ks);
+	if (bad_cons) isolate->ThrowError("[k8_iidx_fromBed] must be called as IntervalIndex.fromBed()");
+	else args.GetReturnValue().Set(ret);
+}
+
+/*************************
+ *** The ByteMap class ***
+ *************************/
+
+#define K8_BMAP_MAGIC (0x426d70)
+
+typedef struct {
+	int64_t off; // offset of the key in the arena
+	uint32_t len, hash;
+	double val;
+} k8_bent_t;
+
+typedef struct { // open-addressing hash table from byte strings to numbers; keys are kept in an arena in the insertion order
+	uint64_t magic;
+	int32_t is_counter; // get() returns 0 instead of undefined for absent keys
+	int32_t bits; // the table has 1<<bits slots
+	uint32_t *h; // 1-based index into e[]; 0 for an empty slot
+	int64_t n, m;
+	k8_bent_t *e;
+	kstring_t arena, tmp; // tmp: a key converted from a string
+	int64_t n_ext; // memory reported to V8
+	v8::Global<v8::Object> *ref;
+} k8_bmap_t;
+
+static inline uint64_t k8_hash_bytes(const uint8_t *p, int64_t len) // 8 bytes at a time, finalized with the murmur3 mixer
+{
+	uint64_t h = 0x9e3779b97f4a7c15ULL ^ (uint64_t)len, x;
+	for (; len >= 8; p += 8, len -= 8) {
+		memcpy(&x, p, 8);
+		h = (h ^ x) * 0xff51afd7ed558ccdULL;
+		h ^= h >> 32;
+	}
+	if (len > 0) {
+		x = 0, memcpy(&x, p, len);
+		h = (h ^ x) * 0xff51afd7ed558ccdULL;
+	}
+	h ^= h >> 33, h *= 0xc4ceb9fe1a85ec53ULL, h ^= h >> 33;
+	return h;
+}
+
+static void k8_bmap_resize(k8_bmap_t *t, int32_t bits) // rehash with stored hash values; keys are not touched
+{
+	uint32_t mask = (1U<<bits) - 1, *h = K8_CALLOC(uint32_t, 1ULL<<bits);
+	for (int64_t i = 0; i < t->n; ++i) {
+		uint32_t k = t->e[i].hash & mask;
+		while (h[k]) k = (k + 1) & mask;
+		h[k] = i + 1;
+	}
+	free(t->h);
+	t->h = h, t->bits = bits;
+}
+
+static int64_t k8_bmap_get(const k8_bmap_t *t, const uint8_t *key, int64_t len) // return the index of $key or -1 if absent
+{
+	if (t->h == 0) return -1;
+	uint32_t hash = (uint32_t)k8_hash_bytes(key, len), mask = (1U<<t->bits) - 1, k = hash & mask;
+	for (; t->h[k]; k = (k + 1) & mask) {
+		const k8_bent_t *p = &t->e[t->h[k] - 1];
+		if (p->hash == hash && p->len == len && memcmp(&t->arena.s[p->off], key, len) == 0)
+			return t->h[k] - 1;
+	}
+	return -1;
+}
+
+static int64_t k8_bmap_put(k8_bmap_t *t, const uint8_t *key, int64_t len) // return the index of $key, adding it with value 0 if absent
+{
+	if ((t->n + 1) * 4 > (3LL << t->bits)) k8_bmap_resize(t, t->bits < 4? 4 : t->bits + 1); // load factor at most 0.75
+	uint32_t hash = (uint32_t)k8_hash_bytes(key, len), mask = (1U<<t->bits) - 1, k = hash & mask;
+	for (; t->h[k]; k = (k + 1) & mask) {
+		const k8_bent_t *p = &t->e[t->h[k] - 1];
+		if (p->hash == hash && p->len == len && memcmp(&t->arena.s[p->off], key, len) == 0)
+			return t->h[k] - 1;
+	}
+	K8_GROW(k8_bent_t, t->e, t->n, t->m);
+	k8_bent_t *p = &t->e[t->n];
+	p->off = t->arena.l, p->len = len, p->hash = hash, p->val = 0.0;
+	if (len > 0) {
+		K8_GROW(uint8_t, t->arena.s, t->arena.l + len - 1, t->arena.m);
+		memcpy(&t->arena.s[t->arena.l], key, len);
+		t->arena.l += len;
+	}
+	t->h[k] = ++t->n;
+	return t->n - 1;
+}
+
+static inline void k8_bmap_sync(v8::Isolate *isolate, k8_bmap_t *t)
+{
+	int64_t x = t->m * sizeof(k8_bent_t) + (t->h? 1LL<<t->bits : 0) * sizeof(uint32_t) + t->arena.m + t->tmp.m;
+	if (x != t->n_ext) {
+		isolate->AdjustAmountOfExternalAllocatedMemory(x - t->n_ext);
+		t->n_ext = x;
+	}
+}
+
+static void k8_bmap_clear(k8_bmap_t *t)
+{
+	free(t->h); free(t->e); free(t->arena.s); free(t->tmp.s);
+	t->h = 0, t->e = 0, t->arena.s = t->tmp.s = 0;
+	t->bits = 0, t->n = t->m = 0, t->arena.l = t->arena.m = t->tmp.l = t->tmp.m = 0;
+}
+
+static void k8_bmap_gc_cb2(const v8::WeakCallbackInfo<k8_bmap_t> &info)
+{
+	k8_bmap_t *t = info.GetParameter();
+	info.GetIsolate()->AdjustAmountOfExternalAllocatedMemory(-t->n_ext);
+	k8_bmap_clear(t);
+	free(t);
+}
+
+static void k8_bmap_gc_cb(const v8::WeakCallbackInfo<k8_bmap_t> &info)
+{
+	k8_bmap_t *t = info.GetParameter();
+	t->ref->Reset();
+	delete t->ref;
+	t->ref = 0;
+	info.SetSecondPassCallback(k8_bmap_gc_cb2);
+}
+
+static void k8_bmap_init(const v8::FunctionCallbackInfo<v8::Value> &args, int32_t is_counter)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bmap_t *t = K8_CALLOC(k8_bmap_t, 1);
+	t->magic = K8_BMAP_MAGIC;
+	t->is_counter = is_counter;
+	K8_SAVE_PTR(args, 0, t);
+	if (!k8_making_snapshot) {
+		t->ref = new v8::Global<v8::Object>(args.GetIsolate(), args.This());
+		t->ref->SetWeak(t, k8_bmap_gc_cb, v8::WeakCallbackType::kParameter);
+	}
+}
+
+static void k8_bmap_new(const v8::FunctionCallbackInfo<v8::Value> &args) { k8_bmap_init(args, 0); }
+static void k8_bcnt_new(const v8::FunctionCallbackInfo<v8::Value> &args) { k8_bmap_init(args, 1); }
+
+static const uint8_t *k8_bmap_get_key(const v8::FunctionCallbackInfo<v8::Value> &args, k8_bmap_t *t, int32_t i_range, int64_t *len) // a string or a Bytes object at args[0] with optional [start,end) at args[i_range]
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	if (args.Length() > 0 && args[0]->IsString()) { // one byte per character, the same as Bytes.prototype.set()
+		int32_t l = args[0].As<v8::String>()->Length();
+		K8_GROW(uint8_t, t->tmp.s, l, t->tmp.m);
+		args[0].As<v8::String>()->WriteOneByte(isolate, t->tmp.s, 0, l, v8::String::NO_NULL_TERMINATION);
+		*len = l;
+		return t->tmp.s;
+	}
+	k8_bytes_t *a = args.Length() > 0? k8_get_bytes(args[0]) : 0;
+	if (a == 0) {
+		isolate->ThrowError("[k8_bmap_get_key] the key must be a string or a Bytes object");
+		return 0;
+	}
+	int64_t st, en;
+	k8_bytes_get_range(args, i_range, a, &st, &en);
+	*len = en - st;
+	return a->buf.s? &a->buf.s[st] : (const uint8_t*)"";
+}
+
+static void k8_bmap_get_js(const v8::FunctionCallbackInfo<v8::Value> &args) // get(key, start?, end?)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	int64_t len, i;
+	const uint8_t *key = k8_bmap_get_key(args, t, 1, &len);
+	if (key == 0) return;
+	i = k8_bmap_get(t, key, len);
+	if (i >= 0) args.GetReturnValue().Set(t->e[i].val);
+	else if (t->is_counter) args.GetReturnValue().Set(0);
+}
+
+static void k8_bmap_has(const v8::FunctionCallbackInfo<v8::Value> &args) // has(key, start?, end?)
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	int64_t len;
+	const uint8_t *key = k8_bmap_get_key(args, t, 1, &len);
+	if (key == 0) return;
+	args.GetReturnValue().Set(k8_bmap_get(t, key, len) >= 0);
+}
+
+static void k8_bmap_set(const v8::FunctionCallbackInfo<v8::Value> &args) // set(key, val, start?, end?): return the index of $key
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	int64_t len, i;
+	const uint8_t *key = k8_bmap_get_key(args, t, 2, &len);
+	if (key == 0) return;
+	i = k8_bmap_put(t, key, len);
+	t->e[i].val = args.Length() > 1? args[1]->NumberValue(isolate->GetCurrentContext()).FromMaybe(0.0) : 0.0;
+	k8_bmap_sync(isolate, t);
+	args.GetReturnValue().Set((double)i);
+}
+
+static void k8_bmap_inc(const v8::FunctionCallbackInfo<v8::Value> &args) // inc(key, delta?, start?, end?): return the new value
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	int64_t len, i;
+	const uint8_t *key = k8_bmap_get_key(args, t, 2, &len);
+	if (key == 0) return;
+	i = k8_bmap_put(t, key, len);
+	t->e[i].val += args.Length() > 1 && !args[1]->IsUndefined()? args[1]->NumberValue(isolate->GetCurrentContext()).FromMaybe(1.0) : 1.0;
+	k8_bmap_sync(isolate, t);
+	args.GetReturnValue().Set(t->e[i].val);
+}
+
+static void k8_bmap_key(const v8::FunctionCallbackInfo<v8::Value> &args) // key(i): the i-th key in the insertion order as a string
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0 || args.Length() == 0) return;
+	int64_t i = args[0]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(-1);
+	if (i < 0 || i >= t->n) return;
+	const k8_bent_t *p = &t->e[i];
+	args.GetReturnValue().Set(v8::String::NewFromOneByte(isolate, p->len? &t->arena.s[p->off] : (const uint8_t*)"", v8::NewStringType::kNormal, p->len).ToLocalChecked());
+}
+
+static void k8_bmap_value(const v8::FunctionCallbackInfo<v8::Value> &args) // value(i): the value of the i-th key
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0 || args.Length() == 0) return;
+	int64_t i = args[0]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(-1);
+	if (i < 0 || i >= t->n) return;
+	args.GetReturnValue().Set(t->e[i].val);
+}
+
+static void k8_bmap_entries(const v8::FunctionCallbackInfo<v8::Value> &args) // entries(keys, offsets, values, start?): return the number of entries written
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	k8_bytes_t *a = args.Length() > 0? k8_get_bytes(args[0]) : 0;
+	if (args.Length() < 3 || (a == 0 && !args[0]->IsNull() && !args[0]->IsUndefined())
+		|| (a && !(args[1]->IsInt32Array() || args[1]->IsFloat64Array()))
+		|| !(args[2]->IsFloat64Array() || args[2]->IsNull() || args[2]->IsUndefined()))
+	{
+		isolate->ThrowError("[k8_bmap_entries] the arguments must be Bytes|null, Int32Array|Float64Array and Float64Array|null");
+		return;
+	}
+	int64_t i, j, st, n, max = INT64_MAX;
+	st = args.Length() > 3? args[3]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+	if (st < 0) st = 0;
+	if (st > t->n) st = t->n;
+	void *off = 0;
+	double *val = 0;
+	if (a) {
+		v8::Local<v8::TypedArray> ta = args[1].As<v8::TypedArray>();
+		off = (uint8_t*)ta->Buffer()->Data() + ta->ByteOffset();
+		max = ta->Length() / 2;
+	}
+	if (args[2]->IsFloat64Array()) {
+		v8::Local<v8::TypedArray> ta = args[2].As<v8::TypedArray>();
+		val = (double*)((uint8_t*)ta->Buffer()->Data() + ta->ByteOffset());
+		if (max > (int64_t)ta->Length()) max = ta->Length();
+	}
+	n = t->n - st < max? t->n - st : max;
+	if (a) {
+		int64_t l = 0, is_i32 = args[1]->IsInt32Array();
+		for (i = st; i < st + n; ++i) l += t->e[i].len;
+		K8_GROW(uint8_t, a->buf.s, l, a->buf.m);
+		for (i = st, j = 0, l = 0; i < st + n; ++i, ++j) {
+			const k8_bent_t *p = &t->e[i];
+			if (p->len) memcpy(&a->buf.s[l], &t->arena.s[p->off], p->len);
+			if (is_i32) ((int32_t*)off)[j*2] = l, ((int32_t*)off)[j*2+1] = l + p->len;
+			else ((double*)off)[j*2] = l, ((double*)off)[j*2+1] = l + p->len;
+			l += p->len;
+		}
+		a->buf.l = l;
+		k8_bytes_sync(isolate, a);
+	}
+	if (val)
+		for (i = 0; i < n; ++i)
+			val[i] = t->e[st + i].val;
+	args.GetReturnValue().Set((double)n);
+}
+
+static void k8_bmap_clear_js(const v8::FunctionCallbackInfo<v8::Value> &args) // clear(): remove all keys and free the memory
+{
+	v8::HandleScope handle_scope(args.GetIsolate());
+	k8_bmap_t *t = K8_LOAD_PTR(args, 0, k8_bmap_t);
+	if (t == 0) return;
+	k8_bmap_clear(t);
+	k8_bmap_sync(args.GetIsolate(), t);
+}
+
+static void k8_bmap_size_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+{
+	v8::HandleScope handle_scope(info.GetIsolate());
+	k8_bmap_t *t = K8_LOAD_PTR(info, 0, k8_bmap_t);
+	if (t == 0) return;
+	info.GetReturnValue().Set((double)t->n);
+}
+
+/*****************************
+ *** The TabixReader class ***
+ *****************************/
+
+#define K8_TBX_MAGIC     (0x546278)
+#define K8_TBX_MIN_SHIFT 14 // the binning scheme of BAM and tabix: 6 levels with 16kb windows at the bottom
+#define K8_TBX_DEPTH     5
+#define K8_TBX_MAX_POS   (1LL<<(K8_TBX_MIN_SHIFT + K8_TBX_DEPTH * 3))
+#define K8_TBX_META_BIN  37450 // pseudo-bin with statistics in .tbi files written by htslib
+#define K8_TBX_UNSET     ((uint64_t)-1)
+
+typedef struct { // as in the .tbi header; columns are 1-based
+	int32_t preset; // 0 for generic and 2 for VCF; OR'ed with 0x10000 for 0-based half-open coordinates as in BED
+	int32_t sc, bc, ec; // sequence, start and end columns; ec=0 if there is no end column
+	int32_t meta, skip; // lines starting with $meta and the first $skip lines are not indexed
+} k8_tconf_t;
+
+typedef struct {
+	uint32_t bin;
+	uint64_t beg, end; // virtual offsets
+} k8_tchunk_t;
+
+typedef struct {
+	uint64_t beg, end;
+} k8_toff_t;
+
+typedef struct { // index of one sequence
+	int64_t n, m;
+	k8_tchunk_t *a; // sorted by bin and then by beg
+	int64_t n_lin, m_lin;
+	uint64_t *lin; // linear index: the smallest offset of lines overlapping each 16kb window
+} k8_tidx_t;
+
+typedef struct {
+	uint64_t magic;
+	k8_file_t *ks;
+	k8_tconf_t conf;
+	k8_bmap_t names; // sequence names; the index of a name is the sequence ID
+	int64_t m_idx;
+	k8_tidx_t *idx; // names.n elements
+	int64_t tid, beg, end; // the region being queried; tid=-1 if there is no active query
+	int64_t i_off, n_off, m_off;
+	k8_toff_t *off; // merged chunks to read for the query
+	uint64_t cur; // virtual offset of the next line; K8_TBX_UNSET before the first line of a query
+	kstring_t line;
+	int64_t n_ext; // memory reported to V8
+	v8::Global<v8::Object> *ref;
+} k8_tbx_t;
+
+static const k8_tconf_t k8_tconf_bed = { 0x10000, 1, 2, 3, '#', 0 };
+static const k8_tconf_t k8_tconf_vcf = { 2, 1, 2, 0, '#', 0 };
+static const k8_tconf_t k8_tconf_gff = { 0, 1, 4, 5, '#', 0 };
+
+static int32_t k8_tbx_parse(const k8_tconf_t *c, const uint8_t *s, int64_t l, int64_t *name_st, int64_t *name_en, int64_t *beg, int64_t *end) // name at s[*name_st,*name_en) and 0-based [*beg,*end); return -1 if a column is missing or not a number
+{
+	int32_t is_vcf = (c->preset & 0xffff) == 2, k_max = c->sc > c->bc? c->sc : c->bc;
+	int64_t i, j, k, ref_len = 0, info_end = -1;
+	double x;
+	if (c->ec > k_max) k_max = c->ec;
+	if (is_vcf && k_max < 8) k_max = 8;
+	*name_st = *name_en = *beg = *end = -1;
+	for (i = j = 0, k = 1; i <= l && k <= k_max; ++i) {
+		if (i < l && s[i] != '\t') continue;
+		if (k == c->sc) {
+			*name_st = j, *name_en = i;
+		} else if (k == c->bc || k == c->ec) {
+			if (isnan(x = k8_parse_int(&s[j], &s[i]))) return -1;
+			if (k == c->bc) *beg = (int64_t)x - ((c->preset & 0x10000)? 0 : 1);
+			else *end = (int64_t)x;
+		} else if (is_vcf && k == 4) {
+			ref_len = i - j;
+		} else if (is_vcf && k == 8) { // END in INFO
+			for (int64_t p = j; p + 4 < i; ++p)
+				if ((p == j || s[p-1] == ';') && memcmp(&s[p], "END=", 4) == 0) {
+					if (!isnan(x = k8_parse_int(&s[p+4], &s[i]))) info_end = (int64_t)x;
+					break;
+				}
+		}
+		++k, j = i + 1;
+	}
+	if (*name_st < 0 || *beg < 0) return -1;
+	if (is_vcf) *end = info_end > *beg? info_end : *beg + (ref_len > 0? ref_len : 1);
+	if (*end <= *beg) *end = *beg + 1;
+	return 0;
+}
+
+static inline uint32_t k8_tbx_reg2bin(int64_t beg, int64_t end) // the smallest bin containing [beg,end)
+{
+	int32_t l, s = K8_TBX_MIN_SHIFT, t = ((1<<K8_TBX_DEPTH*3) - 1) / 7;
+	for (--end, l = K8_TBX_DEPTH; l > 0; --l, s += 3, t -= 1<<l*3)
+		if (beg>>s == end>>s) return t + (beg>>s);
+	return 0;
+}
+
+static inline void k8_tidx_push(k8_tidx_t *x, uint32_t bin, uint64_t beg, uint64_t end)
+{
+	K8_GROW(k8_tchunk_t, x->a, x->n, x->m);
+	x->a[x->n].bin = bin, x->a[x->n].beg = beg, x->a[x->n].end = end;
+	++x->n;
+}
+
+static int k8_tchunk_cmp(const void *a, const void *b)
+{
+	const k8_tchunk_t *p = (const k8_tchunk_t*)a, *q = (const k8_tchunk_t*)b;
+	if (p->bin != q->bin) return p->bin < q->bin? -1 : 1;
+	return p->beg < q->beg? -1 : p->beg > q->beg;
+}
+
+static int k8_toff_cmp(const void *a, const void *b)
+{
+	const k8_toff_t *p = (const k8_toff_t*)a, *q = (const k8_toff_t*)b;
+	return p->beg < q->beg? -1 : p->beg > q->beg;
+}
+
+static void k8_tidx_finish(k8_tidx_t *x) // sort chunks, merge chunks in the same bin that end and start in the same BGZF block, and fill empty windows
+{
+	int64_t i, k;
+	qsort(x->a, x->n, sizeof(k8_tchunk_t), k8_tchunk_cmp);
+	for (i = 1, k = 0; i < x->n; ++i) {
+		if (x->a[i].bin == x->a[k].bin && x->a[i].beg >> 16 <= x->a[k].end >> 16) {
+			if (x->a[i].end > x->a[k].end) x->a[k].end = x->a[i].end;
+		} else x->a[++k] = x->a[i];
+	}
+	if (x->n > 0) x->n = k + 1;
+	for (i = x->n_lin - 2; i >= 0; --i) // a line overlapping a later window can't start before the first line overlapping the next window
+		if (x->lin[i] == K8_TBX_UNSET) x->lin[i] = x->lin[i+1];
+}
+
+static int32_t k8_tbx_build1(k8_tbx_t *t, k8_file_t *ks)
+{
+	k8_tidx_t *x = 0;
+	int64_t n_line = 0, last_tid = -1, last_beg = -1, ret, i;
+	uint32_t last_bin = 0;
+	uint64_t off0, off1, save_beg = 0, save_end = 0;
+	off0 = ks_tell(ks);
+	while ((ret = ks_getuntil2(ks, KS_SEP_LINE, &t->line, 0, 0)) >= 0) {
+		int64_t ns, ne, beg, end, tid, w;
+		uint32_t bin;
+		off1 = ks_tell(ks);
+		if (++n_line <= t->conf.skip || t->line.l == 0 || t->line.s[0] == t->conf.meta || k8_tbx_parse(&t->conf, t->line.s, t->line.l, &ns, &ne, &beg, &end) < 0) {
+			off0 = off1;
+			continue;
+		}
+		if (end > K8_TBX_MAX_POS) return -2;
+		tid = k8_bmap_put(&t->names, &t->line.s[ns], ne - ns);
+		if (tid != last_tid) {
+			if (tid != t->names.n - 1) return -1; // the sequence has been seen before
+			if (x) k8_tidx_push(x, last_bin, save_beg, save_end);
+			K8_GROW0(k8_tidx_t, t->idx, tid, t->m_idx);
+			x = &t->idx[tid], last_tid = tid, last_bin = (uint32_t)-1;
+		} else if (beg < last_beg) return -1;
+		last_beg = beg;
+		if ((bin = k8_tbx_reg2bin(beg, end)) != last_bin) { // start a new chunk
+			if (last_bin != (uint32_t)-1) k8_tidx_push(x, last_bin, save_beg, save_end);
+			last_bin = bin, save_beg = off0;
+		}
+		save_end = off1;
+		if ((end - 1) >> K8_TBX_MIN_SHIFT >= x->n_lin) {
+			K8_GROW(uint64_t, x->lin, (end - 1) >> K8_TBX_MIN_SHIFT, x->m_lin);
+			for (; x->n_lin <= (end - 1) >> K8_TBX_MIN_SHIFT; ++x->n_lin) x->lin[x->n_lin] = K8_TBX_UNSET;
+		}
+		for (w = beg >> K8_TBX_MIN_SHIFT; w <= (end - 1) >> K8_TBX_MIN_SHIFT; ++w)
+			if (x->lin[w] == K8_TBX_UNSET) x->lin[w] = off0;
+		off0 = off1;
+	}
+	if (ret < -1) return -3;
+	if (x) k8_tidx_push(x, last_bin, save_beg, save_end);
+	for (i = 0; i < t->names.n; ++i)
+		k8_tidx_finish(&t->idx[i]);
+	return 0;
+}
+
+static int32_t k8_tbx_build(k8_tbx_t *t, int32_t n_threads) // index the whole file; return 0 on success, -1 if unsorted, -2 for positions beyond K8_TBX_MAX_POS or -3 on stream errors
+{
+	k8_file_t *ks = n_threads > 0? ks_open(-1, t->ks->fn, 0, n_threads, -1) : t->ks; // threads only help the sequential scan; queries are faster without them
+	int32_t ret;
+	if (ks == 0) return -3;
+	ret = ks_seek(ks, 0) < 0? -3 : k8_tbx_build1(t, ks);
+	if (ks != t->ks) ks_close(ks);
+	return ret;
+}
+
+static int32_t k8_tbx_decode(k8_tbx_t *t, const uint8_t *p, int64_t len) // parse a decompressed .tbi; return 0 on success or -2 if invalid
+{
+	const uint8_t *end = p + len, *q;
+	int64_t i, j, k, n_ref, l_nm;
+	if (len < 36 || memcmp(p, "TBI\1", 4) != 0) return -2;
+	n_ref = (int32_t)ks_get_le32(p + 4);
+	t->conf.preset = ks_get_le32(p + 8), t->conf.sc = ks_get_le32(p + 12), t->conf.bc = ks_get_le32(p + 16);
+	t->conf.ec = ks_get_le32(p + 20), t->conf.meta = ks_get_le32(p + 24), t->conf.skip = ks_get_le32(p + 28);
+	l_nm = (int32_t)ks_get_le32(p + 32);
+	p += 36;
+	if (n_ref < 0 || l_nm < 0 || l_nm > end - p || n_ref > l_nm) return -2;
+	t->m_idx = n_ref; // allocated before the names, as the caller frees $t with partial content if this function fails
+	t->idx = K8_CALLOC(k8_tidx_t, t->m_idx);
+	for (i = 0, q = p; i < n_ref; ++i) { // NUL-terminated names
+		const uint8_t *e = (const uint8_t*)memchr(q, 0, p + l_nm - q);
+		if (e == 0) return -2;
+		k8_bmap_put(&t->names, q, e - q);
+		q = e + 1;
+	}
+	if (t->names.n != n_ref) return -2; // duplicated names
+	p += l_nm;
+	for (i = 0; i < n_ref; ++i) {
+		k8_tidx_t *x = &t->idx[i];
+		int64_t n_bin;
+		if (end - p < 4 || (n_bin = (int32_t)ks_get_le32(p)) < 0) return -2;
+		for (j = 0, p += 4; j < n_bin; ++j) {
+			uint32_t bin;
+			int64_t n_chunk;
+			if (end - p < 8) return -2;
+			bin = ks_get_le32(p), n_chunk = (int32_t)ks_get_le32(p + 4), p += 8;
+			if (n_chunk < 0 || n_chunk > (end - p) / 16) return -2;
+			for (k = 0; k < n_chunk; ++k, p += 16)
+				if (bin != K8_TBX_META_BIN) k8_tidx_push(x, bin, ks_get_le64(p), ks_get_le64(p + 8));
+		}
+		if (end - p < 4 || (x->n_lin = (int32_t)ks_get_le32(p)) < 0 || x->n_lin > (end - p - 4) / 8) return -2;
+		x->m_lin = x->n_lin, x->lin = K8_MALLOC(uint64_t, x->m_lin);
+		for (k = 0, p += 4; k < x->n_lin; ++k, p += 8)
+			x->lin[k] = ks_get_le64(p);
+		k8_tidx_finish(x);
+	}
+	return 0;
+}
+
+static int32_t k8_tbx_load(k8_tbx_t *t, const char *fn) // read a .tbi; return 0 on success, -1 if the file can't be opened or -2 if it is invalid
+{
+	kstring_t s = {0,0,0};
+	k8_file_t *ks = ks_open(-1, fn, 0, 0, -1);
+	int32_t ret;
+	if (ks == 0) return -1;
+	ret = ks_read_all(ks, &s) < 0? -2 : k8_tbx_decode(t, s.s, s.l);
+	ks_close(ks);
+	free(s.s);
+	return ret;
+}
+
+static void k8_tbx_put(kstring_t *s, uint64_t x, int32_t size) // append $x in $size bytes in little endian
+{
+	K8_GROW(uint8_t, s->s, s->l + size, s->m);
+	for (int32_t i = 0; i < size; ++i, x >>= 8)
+		s->s[s->l++] = x & 0xff;
+}
+
+static int32_t k8_tbx_save(const k8_tbx_t *t, const char *fn) // write a .tbi; return 0 on success or -1 on errors
+{
+	kstring_t s = {0,0,0};
+	int64_t i, j, k;
+	int32_t ret;
+	k8_tbx_put(&s, 0x01494254, 4); // "TBI\1"
+	k8_tbx_put(&s, t->names.n, 4);
+	k8_tbx_put(&s, t->conf.preset, 4), k8_tbx_put(&s, t->conf.sc, 4), k8_tbx_put(&s, t->conf.bc, 4);
+	k8_tbx_put(&s, t->conf.ec, 4), k8_tbx_put(&s, t->conf.meta, 4), k8_tbx_put(&s, t->conf.skip, 4);
+	k8_tbx_put(&s, t->names.arena.l + t->names.n, 4);
+	for (i = 0; i < t->names.n; ++i) {
+		const k8_bent_t *e = &t->names.e[i];
+		K8_GROW(uint8_t, s.s, s.l + e->len + 1, s.m);
+		memcpy(&s.s[s.l], &t->names.arena.s[e->off], e->len);
+		s.l += e->len, s.s[s.l++] = 0;
+	}
+	for (i = 0; i < t->names.n; ++i) {
+		const k8_tidx_t *x = &t->idx[i];
+		int64_t n_bin = 0;
+		for (j = 0; j < x->n; ++j)
+			if (j == 0 || x->a[j].bin != x->a[j-1].bin) ++n_bin;
+		k8_tbx_put(&s, n_bin, 4);
+		for (j = 0; j < x->n; j = k) {
+			for (k = j + 1; k < x->n && x->a[k].bin == x->a[j].bin; ++k) {}
+			k8_tbx_put(&s, x->a[j].bin, 4), k8_tbx_put(&s, k - j, 4);
+			for (int64_t l = j; l < k; ++l)
+				k8_tbx_put(&s, x->a[l].beg, 8), k8_tbx_put(&s, x->a[l].end, 8);
 		}
-		if (buf[0] == 0 && env_path && strlen(env_path) + l_fn < K8_PATH_MAX) { // 3) a directory on K8_PATH. TODO: to allow multiple paths separated by ":"
-			strcpy(buf, env_path); strcat(buf, "/"); strcat(buf, *file);
-			if ((fp = fopen(buf, "r")) != 0) fclose(fp);
+		k8_tbx_put(&s, x->n_lin, 4);
+		for (j = 0; j < x->n_lin; ++j)
+			k8_tbx_put(&s, x->lin[j], 8);
+	}
+	k8_file_t *ks = ks_open(-1, fn, "wb", 0, -1);
+	ret = ks == 0 || ks_write(ks, s.s, s.l) < 0 || ks_flush_all(ks) < 0? -1 : 0;
+	ks_close(ks);
+	free(s.s);
+	return ret;
+}
+
+static int64_t k8_tbx_query(k8_tbx_t *t, int64_t tid, int64_t beg, int64_t end) // prepare to read lines overlapping [beg,end) on $tid; return the number of chunks to read or -1 if $tid is invalid
+{
+	const k8_tidx_t *x;
+	int64_t i, k, l, s, b;
+	uint64_t min_off;
+	t->tid = -1, t->n_off = t->i_off = 0, t->cur = K8_TBX_UNSET;
+	if (tid < 0 || tid >= t->names.n) return -1;
+	if (beg < 0) beg = 0;
+	t->tid = tid, t->beg = beg, t->end = end;
+	if (end > K8_TBX_MAX_POS) end = K8_TBX_MAX_POS;
+	if (beg >= end) return 0;
+	x = &t->idx[tid];
+	min_off = x->n_lin == 0? 0 : x->lin[beg >> K8_TBX_MIN_SHIFT < x->n_lin? beg >> K8_TBX_MIN_SHIFT : x->n_lin - 1];
+	for (l = 0, b = 0, s = K8_TBX_MIN_SHIFT + K8_TBX_DEPTH * 3; l <= K8_TBX_DEPTH; s -= 3, b += 1LL << l * 3, ++l) { // bins overlapping the region at each level
+		int64_t lo = 0, hi = x->n, b0 = b + (beg >> s), b1 = b + ((end - 1) >> s);
+		while (lo < hi) { // the first chunk in bin $b0 or after
+			int64_t mid = (lo + hi) >> 1;
+			if (x->a[mid].bin < b0) lo = mid + 1;
+			else hi = mid;
 		}
-		if (buf[0] == 0) {
-			args.GetIsolate()->ThrowError("[load] fail to locate the file");
-			return;
+		for (i = lo; i < x->n && x->a[i].bin <= b1; ++i) {
+			if (x->a[i].end <= min_off) continue;
+			K8_GROW(k8_toff_t, t->off, t->n_off, t->m_off);
+			t->off[t->n_off].beg = x->a[i].beg > min_off? x->a[i].beg : min_off;
+			t->off[t->n_off++].end = x->a[i].end;
 		}
-		v8::Local<v8::String> source;
-		if (!k8_readfile(args.GetIsolate(), buf).ToLocal(&source)) {
-			args.GetIsolate()->ThrowError("[load] fail to read the file");
-			return;
+	}
+	qsort(t->off, t->n_off, sizeof(k8_toff_t), k8_toff_cmp);
+	for (i = 1, k = 0; i < t->n_off; ++i) {
+		if (t->off[i].beg <= t->off[k].end) {
+			if (t->off[i].end > t->off[k].end) t->off[k].end = t->off[i].end;
+		} else t->off[++k] = t->off[i];
+	}
+	if (t->n_off > 0) t->n_off = k + 1;
+	return t->n_off;
+}
+
+static int64_t k8_tbx_next(k8_tbx_t *t, kstring_t *str) // read the next line overlapping the queried region; return its length, -1 at the end or -3 on stream errors
+{
+	int64_t ret = -1, ns, ne, beg, end;
+	if (t->tid < 0) return -1;
+	const k8_bent_t *e = &t->names.e[t->tid];
+	for (;;) {
+		while (t->i_off < t->n_off && t->cur != K8_TBX_UNSET && t->cur >= t->off[t->i_off].end)
+			++t->i_off;
+		if (t->i_off == t->n_off) break;
+		if (t->cur == K8_TBX_UNSET || t->cur < t->off[t->i_off].beg) {
+			if (ks_seek(t->ks, t->off[t->i_off].beg) < 0) {
+				ret = -3;
+				break;
+			}
+			t->cur = t->off[t->i_off].beg;
 		}
-		if (!k8_execute(args.GetIsolate(), source, args[i], false)) {
-			args.GetIsolate()->ThrowError("[load] fail to execute the file");
-			return;
+		if ((ret = ks_getuntil2(t->ks, KS_SEP_LINE, str, 0, 0)) < 0) break;
+		t->cur = ks_tell(t->ks);
+		if (str->l == 0 || str->s[0] == t->conf.meta || k8_tbx_parse(&t->conf, str->s, str->l, &ns, &ne, &beg, &end) < 0)
+			continue;
+		if (ne - ns != e->len || memcmp(&str->s[ns], &t->names.arena.s[e->off], e->len) != 0 || beg >= t->end) { // lines are sorted, so no more lines overlap
+			ret = -1;
+			break;
 		}
+		if (end > t->beg) return str->l;
 	}
+	t->tid = -1;
+	str->l = 0;
+	return ret < -1? ret : -1;
 }
 
-static void k8_read_file(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_tbx_sync(v8::Isolate *isolate, k8_tbx_t *t)
 {
-	if (args.Length() != 1) return;
-	v8::HandleScope handle_scope(args.GetIsolate());
-	v8::String::Utf8Value fn(args.GetIsolate(), args[0]);
-	k8_file_t *fp = ks_open(-1, *fn, "r");
-	if (fp == 0) return;
-	kstring_t buf = {0,0,0};
-	if (ks_read_all(fp, &buf) < 0) return;
-	v8::Handle<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(args.GetIsolate(), buf.l);
-	memcpy(ab->GetBackingStore()->Data(), buf.s, buf.l);
-	args.GetReturnValue().Set(ab);
+	int64_t x = t->m_idx * sizeof(k8_tidx_t) + t->m_off * sizeof(k8_toff_t) + t->line.m + (t->ks? ks_mem(t->ks) : 0);
+	x += t->names.m * sizeof(k8_bent_t) + (t->names.h? 1LL<<t->names.bits : 0) * sizeof(uint32_t) + t->names.arena.m;
+	for (int64_t i = 0; i < t->m_idx; ++i)
+		x += t->idx[i].m * sizeof(k8_tchunk_t) + t->idx[i].m_lin * sizeof(uint64_t);
+	if (x != t->n_ext) {
+		isolate->AdjustAmountOfExternalAllocatedMemory(x - t->n_ext);
+		t->n_ext = x;
+	}
 }
 
-static void k8_encode(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_tbx_free(v8::Isolate *isolate, k8_tbx_t *t)
+{
+	isolate->AdjustAmountOfExternalAllocatedMemory(-t->n_ext);
+	for (int64_t i = 0; i < t->m_idx; ++i)
+		free(t->idx[i].a), free(t->idx[i].lin);
+	free(t->idx); free(t->off); free(t->line.s);
+	k8_bmap_clear(&t->names);
+	ks_close(t->ks);
+	free(t);
+}
+
+static void k8_tbx_gc_cb2(const v8::WeakCallbackInfo<k8_tbx_t> &info)
+{
+	k8_tbx_free(info.GetIsolate(), info.GetParameter());
+}
+
+static void k8_tbx_gc_cb(const v8::WeakCallbackInfo<k8_tbx_t> &info)
+{
+	k8_tbx_t *t = info.GetParameter();
+	t->ref->Reset();
+	delete t->ref;
+	t->ref = 0;
+	info.SetSecondPassCallback(k8_tbx_gc_cb2);
+}
+
+static int32_t k8_tbx_conf(v8::Isolate *isolate, v8::Local<v8::Value> opt, const char *fn, k8_tconf_t *c) // the preset from $opt or from the file name; return -1 for an unknown preset
+{
+	char preset[16], meta[2];
+	int32_t l = strlen(fn), zero_based;
+	if (k8_get_opt_str(isolate, opt, "preset", preset, 16) < 0) { // guess from the file extension
+		if (l > 3 && strcmp(fn + l - 3, ".gz") == 0) l -= 3;
+		else if (l > 4 && strcmp(fn + l - 4, ".bgz") == 0) l -= 4;
+		if (l > 4 && strncmp(fn + l - 4, ".vcf", 4) == 0) strcpy(preset, "vcf");
+		else if ((l > 4 && (strncmp(fn + l - 4, ".gff", 4) == 0 || strncmp(fn + l - 4, ".gtf", 4) == 0)) || (l > 5 && strncmp(fn + l - 5, ".gff3", 5) == 0))
+			strcpy(preset, "gff");
+		else strcpy(preset, "bed");
+	}
+	if (strcmp(preset, "bed") == 0) *c = k8_tconf_bed;
+	else if (strcmp(preset, "vcf") == 0) *c = k8_tconf_vcf;
+	else if (strcmp(preset, "gff") == 0) *c = k8_tconf_gff;
+	else return -1;
+	c->sc = k8_get_opt_int(isolate, opt, "seq", c->sc);
+	c->bc = k8_get_opt_int(isolate, opt, "start", c->bc);
+	c->ec = k8_get_opt_int(isolate, opt, "end", c->ec);
+	c->skip = k8_get_opt_int(isolate, opt, "skip", c->skip);
+	if (k8_get_opt_str(isolate, opt, "meta", meta, 2) >= 0) c->meta = meta[0];
+	if ((zero_based = k8_get_opt_int(isolate, opt, "zeroBased", -1)) >= 0)
+		c->preset = (c->preset & 0xffff) | (zero_based? 0x10000 : 0);
+	return c->sc > 0 && c->bc > 0 && c->ec >= 0? 0 : -1;
+}
+
+static void k8_tbx_new(const v8::FunctionCallbackInfo<v8::Value> &args) // TabixReader(fn, opt?)
 {
-	if (args.Length() == 0 || !args[0]->IsString()) return;
 	v8::Isolate *isolate = args.GetIsolate();
 	v8::HandleScope handle_scope(isolate);
-	int32_t type = 0; // Latin-1
-	if (args.Length() >= 2) {
-		v8::String::Utf8Value e(isolate, args[1]);
-		if (strcmp(*e, "utf8") == 0 || strcmp(*e, "utf-8") == 0 || strcmp(*e, "UTF8") == 0 || strcmp(*e, "UTF-8") == 0)
-			type = 1; // UTF-8
+	if (args.Length() == 0 || !args[0]->IsString()) {
+		isolate->ThrowError("[TabixReader] the first argument must be a file name");
+		return;
 	}
-	if (type == 0) {
-		v8::Handle<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(isolate, args[0].As<v8::String>()->Length());
-		args[0].As<v8::String>()->WriteOneByte(isolate, (uint8_t*)ab->GetBackingStore()->Data());
-		args.GetReturnValue().Set(ab);
-	} else if (type == 1) {
-		v8::Handle<v8::ArrayBuffer> ab = v8::ArrayBuffer::New(isolate, args[0].As<v8::String>()->Utf8Length(isolate));
-		args[0].As<v8::String>()->WriteUtf8(isolate, (char*)ab->GetBackingStore()->Data());
-		args.GetReturnValue().Set(ab);
+	v8::String::Utf8Value fn(isolate, args[0]);
+	v8::Local<v8::Value> opt = args.Length() >= 2? args[1] : v8::Undefined(isolate).As<v8::Value>();
+	k8_file_t *ks = ks_open(-1, *fn, 0, 0, -1);
+	if (ks == 0 || ks->bz == 0) {
+		if (ks) isolate->ThrowError("[TabixReader] the file is not BGZF compressed");
+		else isolate->ThrowError("[TabixReader] failed to open the file");
+		ks_close(ks);
+		return;
+	}
+	k8_tbx_t *t = K8_CALLOC(k8_tbx_t, 1);
+	t->magic = K8_TBX_MAGIC, t->ks = ks, t->tid = -1;
+	args.This()->SetAlignedPointerInInternalField(0, t);
+	if (!k8_making_snapshot) {
+		t->ref = new v8::Global<v8::Object>(isolate, args.This());
+		t->ref->SetWeak(t, k8_tbx_gc_cb, v8::WeakCallbackType::kParameter);
+	}
+	char path[K8_PATH_MAX+1];
+	const char *err = 0;
+	int32_t ret;
+	if (k8_get_opt_str(isolate, opt, "index", path, K8_PATH_MAX + 1) < 0)
+		snprintf(path, K8_PATH_MAX + 1, "%s.tbi", *fn);
+	if ((ret = k8_tbx_load(t, path)) == -2) {
+		err = "[TabixReader] the index is not a valid .tbi";
+	} else if (ret == -1) { // no index; build one in memory
+		if (k8_tbx_conf(isolate, opt, *fn, &t->conf) < 0) err = "[TabixReader] unknown preset or invalid columns";
+		else if ((ret = k8_tbx_build(t, k8_get_opt_int(isolate, opt, "threads", 0))) == -1) err = "[TabixReader] the file is not sorted by position";
+		else if (ret == -2) err = "[TabixReader] positions beyond 2^29 are not supported";
+		else if (ret < 0) err = "[TabixReader] failed to read the file";
 	}
+	k8_tbx_sync(isolate, t);
+	if (err) isolate->ThrowError(v8::String::NewFromUtf8(isolate, err).ToLocalChecked());
 }
 
-static void k8_decode(const v8::FunctionCallbackInfo<v8::Value> &args)
+static int64_t k8_tbx_parse_reg(const k8_tbx_t *t, const char *s, int64_t len, int64_t *beg, int64_t *end) // "seq:beg-end" in 1-based closed coordinates; return the sequence ID, -1 if absent or -2 if malformed
 {
-	if (args.Length() == 0) return;
-	v8::HandleScope handle_scope(args.GetIsolate());
-	void *data = 0;
-	int64_t len = 0;
-	if (args[0]->IsArrayBuffer())  {
-		data = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
-		len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
-	} else if (args[0]->IsObject()) {
-		if (args[0].As<v8::Object>()->InternalFieldCount() > 0) {
-			k8_bytes_t *a = (k8_bytes_t*)args[0].As<v8::Object>()->GetAlignedPointerFromInternalField(0);
-			if (a && a->magic == K8_BYTES_MAGIC)
-				data = a->buf.s, len = a->buf.l;
-		}
+	int64_t i, tid, x = 0, y = 0, k = 0;
+	for (i = len - 1; i >= 0 && s[i] != ':'; --i) {}
+	if (i < 0) return -1;
+	if ((tid = k8_bmap_get(&t->names, (const uint8_t*)s, i)) < 0) return -1;
+	for (++i; i < len; ++i) { // thousands separators are allowed
+		if (s[i] >= '0' && s[i] <= '9') {
+			if (k == 0) x = x * 10 + (s[i] - '0');
+			else y = y * 10 + (s[i] - '0');
+		} else if (s[i] == '-' && k == 0) k = 1;
+		else if (s[i] != ',') return -2;
 	}
-	if (data == 0) return;
-	int32_t type = 0; // Latin-1
-	if (args.Length() >= 2) {
-		v8::String::Utf8Value e(args.GetIsolate(), args[1]);
-		if (strcmp(*e, "utf8") == 0 || strcmp(*e, "utf-8") == 0 || strcmp(*e, "UTF8") == 0 || strcmp(*e, "UTF-8") == 0)
-			type = 1; // UTF-8
+	*beg = x > 0? x - 1 : 0;
+	*end = k && y > 0? y : INT64_MAX;
+	return tid;
+}
+
+static void k8_tbx_query_js(const v8::FunctionCallbackInfo<v8::Value> &args) // query(region) or query(seq, start, end)
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_tbx_t *t = K8_LOAD_PTR(args, 0, k8_tbx_t);
+	if (t == 0) return;
+	if (args.Length() == 0 || !args[0]->IsString()) {
+		args.GetReturnValue().Set(-2);
+		return;
 	}
-	v8::Local<v8::String> str;
-	if (type == 0) {
-		if (v8::String::NewFromOneByte(args.GetIsolate(), (uint8_t*)data, v8::NewStringType::kNormal, len).ToLocal(&str))
-			args.GetReturnValue().Set(str);
-	} else if (type == 1) {
-		if (v8::String::NewFromUtf8(args.GetIsolate(), (char*)data, v8::NewStringType::kNormal, len).ToLocal(&str))
-			args.GetReturnValue().Set(str);
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	v8::String::Utf8Value str(isolate, args[0]);
+	int64_t tid, beg = 0, end = INT64_MAX;
+	tid = k8_bmap_get(&t->names, (const uint8_t*)*str, str.length());
+	if (args.Length() >= 2) { // 0-based half-open
+		double x = args[1]->NumberValue(ctx).FromMaybe(0.0);
+		double y = args.Length() >= 3? args[2]->NumberValue(ctx).FromMaybe(INFINITY) : INFINITY;
+		beg = x > 0.0? (int64_t)x : 0;
+		end = y < (double)K8_TBX_MAX_POS? (int64_t)y : INT64_MAX;
+	} else if (tid < 0) {
+		tid = k8_tbx_parse_reg(t, *str, str.length(), &beg, &end);
 	}
+	if (tid < 0) t->tid = -1;
+	else k8_tbx_query(t, tid, beg, end);
+	k8_tbx_sync(isolate, t);
+	args.GetReturnValue().Set(tid < 0? (int32_t)tid : 0);
 }
 
-static void k8_version(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_tbx_next_js(const v8::FunctionCallbackInfo<v8::Value> &args) // next(buf): read the next overlapping line
 {
-	args.GetReturnValue().Set(v8::String::NewFromUtf8Literal(args.GetIsolate(), K8_VERSION));
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_tbx_t *t = K8_LOAD_PTR(args, 0, k8_tbx_t);
+	if (t == 0) return;
+	k8_bytes_t *a = args.Length() > 0? k8_get_bytes(args[0]) : 0;
+	if (a == 0) {
+		args.GetReturnValue().Set(-2);
+		return;
+	}
+	int64_t ret = k8_tbx_next(t, &a->buf);
+	k8_bytes_sync(isolate, a);
+	args.GetReturnValue().Set((double)ret);
 }
 
-const char k8_comp_tab[] = {
-	  0,   1,	2,	 3,	  4,   5,	6,	 7,	  8,   9,  10,	11,	 12,  13,  14,	15,
-	 16,  17,  18,	19,	 20,  21,  22,	23,	 24,  25,  26,	27,	 28,  29,  30,	31,
-	 32,  33,  34,	35,	 36,  37,  38,	39,	 40,  41,  42,	43,	 44,  45,  46,	47,
-	 48,  49,  50,	51,	 52,  53,  54,	55,	 56,  57,  58,	59,	 60,  61,  62,	63,
-	 64, 'T', 'V', 'G', 'H', 'E', 'F', 'C', 'D', 'I', 'J', 'M', 'L', 'K', 'N', 'O',
-	'P', 'Q', 'Y', 'S', 'A', 'A', 'B', 'W', 'X', 'R', 'Z',	91,	 92,  93,  94,	95,
-	 64, 't', 'v', 'g', 'h', 'e', 'f', 'c', 'd', 'i', 'j', 'm', 'l', 'k', 'n', 'o',
-	'p', 'q', 'y', 's', 'a', 'a', 'b', 'w', 'x', 'r', 'z', 123, 124, 125, 126, 127
-};
+static void k8_tbx_names(const v8::FunctionCallbackInfo<v8::Value> &args) // names(): sequence names in the order of the file
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_tbx_t *t = K8_LOAD_PTR(args, 0, k8_tbx_t);
+	if (t == 0) return;
+	v8::Local<v8::Context> ctx = isolate->GetCurrentContext();
+	v8::Local<v8::Array> ret = v8::Array::New(isolate, t->names.n);
+	for (int64_t i = 0; i < t->names.n; ++i) {
+		const k8_bent_t *e = &t->names.e[i];
+		ret->Set(ctx, i, v8::String::NewFromUtf8(isolate, (const char*)&t->names.arena.s[e->off], v8::NewStringType::kNormal, e->len).ToLocalChecked()).FromJust();
+	}
+	args.GetReturnValue().Set(ret);
+}
 
-static void k8_revcomp(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_tbx_saveIndex(const v8::FunctionCallbackInfo<v8::Value> &args) // saveIndex(fn?): write the index as a .tbi
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_tbx_t *t = K8_LOAD_PTR(args, 0, k8_tbx_t);
+	if (t == 0) return;
+	char path[K8_PATH_MAX+1];
+	if (args.Length() > 0 && args[0]->IsString()) {
+		v8::String::Utf8Value fn(isolate, args[0]);
+		snprintf(path, K8_PATH_MAX + 1, "%s", k8_cstr(fn));
+	} else snprintf(path, K8_PATH_MAX + 1, "%s.tbi", t->ks->fn);
+	args.GetReturnValue().Set(k8_tbx_save(t, path));
+}
+
+static void k8_tbx_close(const v8::FunctionCallbackInfo<v8::Value> &args)
 {
-	if (args.Length() == 0) return;
 	v8::HandleScope handle_scope(args.GetIsolate());
-	uint8_t *seq = 0;
-	int64_t len = 0;
-	int32_t is_str = 0;
-	if (args[0]->IsArrayBuffer())  {
-		seq = (uint8_t*)args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
-		len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
-	} else if (args[0]->IsObject()) {
-		if (args[0].As<v8::Object>()->InternalFieldCount() > 0) {
-			k8_bytes_t *a = (k8_bytes_t*)args[0].As<v8::Object>()->GetAlignedPointerFromInternalField(0);
-			if (a && a->magic == K8_BYTES_MAGIC)
-				seq = a->buf.s, len = a->buf.l;
+	k8_tbx_t *t = K8_LOAD_PTR(args, 0, k8_tbx_t);
+	if (t == 0) return;
+	if (t->ref) {
+		t->ref->Reset();
+		delete t->ref;
+	}
+	k8_tbx_free(args.GetIsolate(), t);
+	K8_SAVE_PTR(args, 0, 0);
+	args.GetReturnValue().Set(0);
+}
+
+/*********************
+ *** External sort ***
+ *********************/
+
+#define K8_SORT_MAX_MERGE 256 // max number of runs merged at a time; more runs are merged in several levels
+
+typedef struct {
+	int32_t key, sep; // key: 1-based column delimited by $sep, or 0 for the whole line
+	int32_t numeric, reverse;
+} k8_sconf_t;
+
+typedef struct { // a line being sorted
+	uint64_t pfx; // the first 8 bytes of the key in big endian, or the numeric key mapped to an integer of the same order
+	int64_t off; // offset of the line in the buffer of a batch
+	int32_t len, k_off, k_len; // line length and the key at [k_off,k_off+k_len) of the line
+} k8_srec_t;
+
+typedef struct { // the current line of a sorted slice in memory or of a run on disk
+	const uint8_t *s;
+	k8_srec_t r;
+	const uint8_t *buf; // for slices: records a[i..n) with lines in $buf
+	const k8_srec_t *a;
+	int64_t i, n;
+	k8_file_t *ks; // for runs
+	kstring_t line;
+} k8_scur_t;
+
+typedef struct {
+	const k8_sconf_t *c;
+	const uint8_t *buf;
+	k8_srec_t *a, *tmp;
+	int64_t n;
+} k8_sjob_t;
+
+typedef struct { // a sorted run on disk; the file is unlinked once created and read back through $fd
+	int fd, level; // level: 0 for a run from a batch of lines and n+1 for a merge of level-n runs
+	char *fn; // for --stats
+} k8_srun_t;
+
+static void k8_sort_key(const k8_sconf_t *c, const uint8_t *s, k8_srec_t *r) // find the key of line $s of length r->len and compute r->pfx
+{
+	int32_t i, j, k;
+	uint64_t u = 0;
+	r->k_off = 0, r->k_len = r->len;
+	if (c->key > 0) { // an absent column is an empty key
+		r->k_off = r->len, r->k_len = 0;
+		for (i = j = 0, k = 1; i <= r->len; ++i) {
+			if (i < r->len && s[i] != c->sep) continue;
+			if (k++ == c->key) {
+				r->k_off = j, r->k_len = i - j;
+				break;
+			}
+			j = i + 1;
 		}
-	} else if (args[0]->IsString()) {
-		is_str = 1;
-		len = args[0].As<v8::String>()->Length();
-		seq = (uint8_t*)calloc(len + 1, 1);
-		args[0].As<v8::String>()->WriteOneByte(args.GetIsolate(), seq);
 	}
-	if (seq == 0) return;
-	for (int64_t i = 0; i < len>>1; ++i) {
-		uint8_t tmp = seq[len - 1 - i];
-		seq[len - 1 - i] = seq[i] < 128? k8_comp_tab[seq[i]] : seq[i];
-		seq[i] = tmp < 128? k8_comp_tab[tmp] : tmp;
+	if (c->numeric) {
+		double x = k8_parse_float(&s[r->k_off], &s[r->k_off + r->k_len]);
+		if (!isnan(x)) { // flip the bits such that unsigned integers are ordered as doubles; keys without a number come first with u=0
+			memcpy(&u, &x, 8);
+			u = u>>63? ~u : u | 1ULL<<63;
+		}
+	} else {
+		for (i = 0; i < 8; ++i)
+			u = u << 8 | (i < r->k_len? s[r->k_off + i] : 0);
 	}
-	if (len & 1) seq[len>>1] = seq[len>>1] < 128? k8_comp_tab[seq[len>>1]] : seq[len>>1];
-	if (is_str) {
-		v8::Local<v8::String> str;
-		if (v8::String::NewFromOneByte(args.GetIsolate(), seq, v8::NewStringType::kNormal, len).ToLocal(&str))
-			args.GetReturnValue().Set(str);
-		free(seq);
+	r->pfx = u;
+}
+
+static inline int k8_sort_memcmp(const uint8_t *p, int32_t lp, const uint8_t *q, int32_t lq)
+{
+	int r = memcmp(p, q, lp < lq? lp : lq);
+	return r? r : lp - lq;
+}
+
+static inline int k8_sort_cmp(const k8_sconf_t *c, const uint8_t *sp, const k8_srec_t *p, const uint8_t *sq, const k8_srec_t *q) // $sp and $sq point to the lines of $p and $q
+{
+	int r;
+	if (p->pfx != q->pfx) r = p->pfx < q->pfx? -1 : 1;
+	else {
+		r = c->numeric? 0 : k8_sort_memcmp(sp + p->k_off, p->k_len, sq + q->k_off, q->k_len);
+		if (r == 0 && (c->numeric || c->key > 0)) r = k8_sort_memcmp(sp, p->len, sq, q->len); // ties are broken by the whole line
 	}
+	return c->reverse? -r : r;
 }
 
-/***********************
- *** The Bytes class ***
- ***********************/
+static void k8_sort_msort(const k8_sconf_t *c, const uint8_t *buf, k8_srec_t *a, k8_srec_t *tmp, int64_t n) // bottom-up merge sort on insertion-sorted blocks of 16
+{
+	k8_srec_t *src = a, *dst = tmp, *t;
+	int64_t i, j, k, w;
+	for (i = 0; i < n; i += 16) {
+		int64_t e = i + 16 < n? i + 16 : n;
+		for (j = i + 1; j < e; ++j) {
+			k8_srec_t x = a[j];
+			for (k = j; k > i && k8_sort_cmp(c, buf + x.off, &x, buf + a[k-1].off, &a[k-1]) < 0; --k)
+				a[k] = a[k-1];
+			a[k] = x;
+		}
+	}
+	for (w = 16; w < n; w <<= 1) {
+		for (i = 0; i < n; i += w * 2) {
+			int64_t je = i + w < n? i + w : n, ke = i + w * 2 < n? i + w * 2 : n, o = i;
+			for (j = i, k = je; j < je && k < ke;)
+				dst[o++] = k8_sort_cmp(c, buf + src[k].off, &src[k], buf + src[j].off, &src[j]) < 0? src[k++] : src[j++];
+			while (j < je) dst[o++] = src[j++];
+			while (k < ke) dst[o++] = src[k++];
+		}
+		t = src, src = dst, dst = t;
+	}
+	if (src != a) memcpy(a, src, n * sizeof(k8_srec_t));
+}
 
-static void k8_bytes_new(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void *k8_sort_worker(void *data)
 {
-	v8::HandleScope handle_scope(args.GetIsolate());
-	k8_bytes_t *a = K8_CALLOC(k8_bytes_t, 1);
-	a->magic = K8_BYTES_MAGIC;
-	if (args.Length()) {
-		a->buf.m = a->buf.l = args[0]->IntegerValue(args.GetIsolate()->GetCurrentContext()).FromMaybe(0);
-		a->buf.s = K8_CALLOC(uint8_t, a->buf.l);
+	k8_sjob_t *j = (k8_sjob_t*)data;
+	k8_sort_msort(j->c, j->buf, j->a, j->tmp, j->n);
+	return 0;
+}
+
+static int32_t k8_sort_next(const k8_sconf_t *c, k8_scur_t *p) // move to the next line; return -1 at the end or -3 on read errors
+{
+	if (p->ks == 0) {
+		if (p->i == p->n) return -1;
+		p->r = p->a[p->i++], p->s = p->buf + p->r.off;
+		return 0;
 	}
-	K8_SAVE_PTR(args, 0, a);
+	int64_t ret = ks_getuntil2(p->ks, '\n', &p->line, 0, 0);
+	if (ret < 0) return ret < -1? -3 : -1;
+	p->r.off = 0, p->r.len = p->line.l, p->s = p->line.s;
+	k8_sort_key(c, p->s, &p->r);
+	return 0;
 }
 
-static void k8_bytes_destroy(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_sort_sift(const k8_sconf_t *c, k8_scur_t **h, int32_t n, int32_t i)
 {
-	v8::HandleScope handle_scope(args.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
-	if (a == 0) return;
-	free(a->buf.s); free(a);
-	K8_SAVE_PTR(args, 0, 0);
-	args.GetReturnValue().Set(0);
+	for (;;) {
+		int32_t l = i * 2 + 1, m = i;
+		k8_scur_t *t;
+		if (l < n && k8_sort_cmp(c, h[l]->s, &h[l]->r, h[m]->s, &h[m]->r) < 0) m = l;
+		if (l + 1 < n && k8_sort_cmp(c, h[l+1]->s, &h[l+1]->r, h[m]->s, &h[m]->r) < 0) m = l + 1;
+		if (m == i) break;
+		t = h[i], h[i] = h[m], h[m] = t, i = m;
+	}
 }
 
-static void k8_bytes_set(const v8::FunctionCallbackInfo<v8::Value> &args)
+static int32_t k8_sort_merge(const k8_sconf_t *c, k8_scur_t *cur, int32_t n_cur, k8_file_t *out) // write lines from all cursors in order; return 0 on success or -3 on I/O errors
 {
-	v8::Isolate *isolate = args.GetIsolate();
-	v8::HandleScope handle_scope(isolate);
-	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
-	if (a == 0 || args.Length() == 0) return;
-	int64_t pre = a->buf.l;
-	int64_t off = args.Length() >= 2? args[1]->IntegerValue(isolate->GetCurrentContext()).FromMaybe(a->buf.l) : a->buf.l;
-	if (args[0]->IsNumber()) {
-		K8_GROW0(uint8_t, a->buf.s, off, a->buf.m);
-		a->buf.s[off] = (uint8_t)args[0]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
-		a->buf.l = off + 1;
-	} else if (args[0]->IsString()) {
-		int32_t len = args[0].As<v8::String>()->Length();
-		K8_GROW0(uint8_t, a->buf.s, off + len, a->buf.m);
-		args[0].As<v8::String>()->WriteOneByte(isolate, &a->buf.s[off]);
-		a->buf.l = off + len;
-	} else if (args[0]->IsArray()) {
-		v8::Handle<v8::Array> array = v8::Handle<v8::Array>::Cast(args[0]);
-		K8_GROW0(uint8_t, a->buf.s, off + array->Length(), a->buf.m);
-		for (size_t i = 0; i < array->Length(); ++i) {
-			v8::Local<v8::Value> x;
-			if (array->Get(isolate->GetCurrentContext(), i).ToLocal(&x))
-				a->buf.s[off++] = (uint8_t)x->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
+	k8_scur_t **h = K8_MALLOC(k8_scur_t*, n_cur > 0? n_cur : 1);
+	int32_t i, n = 0, ret = 0;
+	for (i = 0; i < n_cur; ++i) {
+		if ((ret = k8_sort_next(c, &cur[i])) == 0) h[n++] = &cur[i];
+		else if (ret < -1) break;
+	}
+	for (i = n / 2 - 1; i >= 0; --i)
+		k8_sort_sift(c, h, n, i);
+	while (n > 0 && ret >= -1) { // a binary heap is enough as $n_cur is small
+		k8_scur_t *p = h[0];
+		memcpy(ks_reserve(out, p->r.len + 1), p->s, p->r.len);
+		out->out.s[out->out.l + p->r.len] = '\n';
+		out->out.l += p->r.len + 1;
+		if ((ret = k8_sort_next(c, p)) < 0) h[0] = h[--n];
+		k8_sort_sift(c, h, n, 0);
+	}
+	free(h);
+	if (ks_flush_all(out) < 0) ret = -3;
+	return ret < -1? -3 : 0;
+}
+
+static k8_file_t *k8_sort_tmp(const char *dir, k8_srun_t **run, int32_t *n_run, int32_t *m_run) // create a temporary file for a run and open it for writing
+{
+	char *fn = K8_MALLOC(char, strlen(dir) + 16);
+	k8_file_t *ks = 0;
+	int fd, fd2 = -1;
+	sprintf(fn, "%s/k8sort.XXXXXX", dir);
+	if ((fd = mkstemp(fn)) < 0) {
+		free(fn);
+		return 0;
+	}
+	unlink(fn); // nothing is left behind if k8 is interrupted; the disk space is freed when both descriptors are closed
+	if ((fd2 = dup(fd)) < 0 || (ks = ks_open(fd, fn, "w", 0, -1)) == 0) {
+		if (fd2 >= 0) close(fd2);
+		close(fd);
+		free(fn);
+		return 0;
+	}
+	K8_GROW(k8_srun_t, *run, *n_run, *m_run);
+	(*run)[*n_run].fd = fd2, (*run)[*n_run].level = 0, (*run)[(*n_run)++].fn = fn;
+	return ks;
+}
+
+static int32_t k8_sort_merge_runs(const k8_sconf_t *c, k8_srun_t *run, int32_t n_run, k8_file_t *out) // merge runs and close them
+{
+	k8_scur_t *cur = K8_CALLOC(k8_scur_t, n_run);
+	int32_t i, ret = 0;
+	for (i = 0; i < n_run; ++i) { // read through the descriptors rather than memory mapped, which would add the runs to the resident memory
+		if (lseek(run[i].fd, 0, SEEK_SET) < 0 || (cur[i].ks = ks_open(run[i].fd, run[i].fn, 0, 0, -1)) == 0) {
+			close(run[i].fd); // ks_open() takes the descriptor only on success
+			ret = -3;
 		}
-		a->buf.l = off;
-	} else if (args[0]->IsArrayBuffer()) {
-		void *data = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
-		int64_t len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
-		K8_GROW0(uint8_t, a->buf.s, off + len, a->buf.m);
-		memcpy(&a->buf.s[off], data, len);
-		a->buf.l = off + len;
-	} else {
-		isolate->ThrowError("[k8_bytes_set] unsupported type");
+		free(run[i].fn);
+	}
+	if (ret == 0) ret = k8_sort_merge(c, cur, n_run, out);
+	for (i = 0; i < n_run; ++i) {
+		ks_close(cur[i].ks);
+		free(cur[i].line.s);
+	}
+	free(cur);
+	return ret;
+}
+
+static int32_t k8_sort_pass(const k8_sconf_t *c, const char *tmp_dir, k8_srun_t **run, int32_t *n_run, int32_t *m_run, int32_t k) // merge the last $k runs to a new run one level up
+{
+	int32_t i, ret, level = 0, st = *n_run - k;
+	k8_file_t *ks = k8_sort_tmp(tmp_dir, run, n_run, m_run); // appended after the $k runs
+	if (ks == 0) return -1;
+	for (i = st; i < st + k; ++i)
+		if ((*run)[i].level > level) level = (*run)[i].level;
+	ret = k8_sort_merge_runs(c, *run + st, k, ks);
+	ks_close(ks);
+	(*run)[st] = (*run)[st + k], (*run)[st].level = level + 1;
+	*n_run = st + 1;
+	return ret;
+}
+
+static int64_t k8_sort_file(const k8_sconf_t *c, k8_file_t *in, k8_file_t *out, int64_t mem, int32_t n_threads, const char *tmp_dir) // return the number of lines, -1 if temporary files can't be created or -3 on I/O errors
+{
+	kstring_t buf = {0,0,0};
+	k8_srec_t *a = 0, *tmp = 0;
+	k8_scur_t *cur = K8_CALLOC(k8_scur_t, n_threads);
+	k8_sjob_t *job = K8_CALLOC(k8_sjob_t, n_threads);
+	pthread_t *tid = K8_CALLOC(pthread_t, n_threads);
+	int64_t i, n = 0, m = 0, n_lines = 0, ret;
+	int32_t n_run = 0, m_run = 0, n_job, err = 0;
+	k8_srun_t *run = 0;
+	for (;;) { // read batches of lines; each batch is sorted in $n_threads slices in parallel and then merged to a run
+		int64_t off = buf.l;
+		if ((ret = ks_getuntil2(in, '\n', &buf, 0, 1)) >= 0) {
+			K8_GROW(k8_srec_t, a, n, m);
+			a[n].off = off, a[n].len = buf.l - off;
+			k8_sort_key(c, buf.s + off, &a[n]);
+			++n;
+			if (buf.l + n * 2 * sizeof(k8_srec_t) < (uint64_t)mem) continue;
+		} else if (ret < -1) {
+			err = -3;
+			break;
+		}
+		tmp = K8_REALLOC(k8_srec_t, tmp, m);
+		n_job = n < n_threads * 1024LL? 1 : n_threads; // not worth threading small batches
+		for (i = 0; i < n_job; ++i) {
+			int64_t st = n * i / n_job, en = n * (i + 1) / n_job;
+			job[i].c = c, job[i].buf = buf.s, job[i].a = a + st, job[i].tmp = tmp + st, job[i].n = en - st;
+			cur[i].buf = buf.s, cur[i].a = a + st, cur[i].i = 0, cur[i].n = en - st;
+		}
+		for (i = 1; i < n_job; ++i) pthread_create(&tid[i], 0, k8_sort_worker, &job[i]);
+		k8_sort_worker(&job[0]);
+		for (i = 1; i < n_job; ++i) pthread_join(tid[i], 0);
+		n_lines += n;
+		if (ret < 0 && n_run == 0) { // the whole input fits in memory
+			err = k8_sort_merge(c, cur, n_job, out);
+			break;
+		}
+		k8_file_t *ks = k8_sort_tmp(tmp_dir, &run, &n_run, &m_run);
+		if (ks == 0) {
+			err = -1;
+			break;
+		}
+		err = k8_sort_merge(c, cur, n_job, ks);
+		ks_close(ks);
+		while (err == 0 && n_run >= K8_SORT_MAX_MERGE && run[n_run - K8_SORT_MAX_MERGE].level == run[n_run - 1].level) // levels never increase along $run, so the last runs are all at this level
+			err = k8_sort_pass(c, tmp_dir, &run, &n_run, &m_run, K8_SORT_MAX_MERGE); // each line is rewritten once per level; this also bounds the number of open descriptors
+		n = 0, buf.l = 0;
+		if (err < 0 || ret < 0) break;
 	}
-	args.GetReturnValue().Set((int32_t)(a->buf.l - pre));
+	free(buf.s); free(a); free(tmp); free(cur); free(job); free(tid);
+	while (err == 0 && n_run > K8_SORT_MAX_MERGE) { // merge the smallest runs until the rest can be merged at once
+		int32_t k = n_run - K8_SORT_MAX_MERGE + 1;
+		err = k8_sort_pass(c, tmp_dir, &run, &n_run, &m_run, k < K8_SORT_MAX_MERGE? k : K8_SORT_MAX_MERGE);
+	}
+	if (err == 0 && n_run > 0) err = k8_sort_merge_runs(c, run, n_run, out), n_run = 0;
+	for (i = 0; i < n_run; ++i) { // close runs left on errors
+		close(run[i].fd);
+		free(run[i].fn);
+	}
+	free(run);
+	return err < 0? err : n_lines;
 }
 
-static void k8_bytes_toString(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_sort(const v8::FunctionCallbackInfo<v8::Value> &args) // k8_sort(inFile, outFile, opt?)
 {
 	v8::Isolate *isolate = args.GetIsolate();
 	v8::HandleScope handle_scope(isolate);
-	k8_bytes_t *a = K8_LOAD_PTR(args, 0, k8_bytes_t);
-	if (a == 0) return;
-	v8::Local<v8::String> str;
-	if (v8::String::NewFromOneByte(args.GetIsolate(), (uint8_t*)a->buf.s, v8::NewStringType::kNormal, a->buf.l).ToLocal(&str))
-		args.GetReturnValue().Set(str);
+	if (args.Length() < 2) {
+		isolate->ThrowError("[k8_sort] the input and the output files are required");
+		return;
+	}
+	v8::Local<v8::Value> opt = args.Length() >= 3? args[2] : v8::Undefined(isolate).As<v8::Value>();
+	char sep[2], mode[8], tmp_dir[K8_PATH_MAX+1];
+	k8_sconf_t c;
+	c.key = k8_get_opt_int(isolate, opt, "key", 0);
+	c.sep = k8_get_opt_str(isolate, opt, "sep", sep, 2) > 0? (uint8_t)sep[0] : '\t';
+	c.numeric = k8_get_opt_int(isolate, opt, "numeric", 0);
+	c.reverse = k8_get_opt_int(isolate, opt, "reverse", 0);
+	int32_t n_threads = k8_get_opt_int(isolate, opt, "threads", 1);
+	int64_t mem = (int64_t)k8_get_opt_int(isolate, opt, "memory", 1024) << 20;
+	if (n_threads < 1) n_threads = 1;
+	if (mem < 1<<20) mem = 1<<20;
+	if (k8_get_opt_str(isolate, opt, "mode", mode, 8) < 0) strcpy(mode, "w");
+	if (k8_get_opt_str(isolate, opt, "tmpDir", tmp_dir, K8_PATH_MAX + 1) < 0)
+		snprintf(tmp_dir, K8_PATH_MAX + 1, "%s", getenv("TMPDIR")? getenv("TMPDIR") : "/tmp");
+	v8::String::Utf8Value fn_in(isolate, args[0]), fn_out(isolate, args[1]);
+	k8_file_t *in = ks_open(-1, *fn_in, 0, n_threads > 1? n_threads : 0, -1);
+	if (in == 0) {
+		isolate->ThrowError("[k8_sort] failed to open the input file");
+		return;
+	}
+	k8_file_t *out = ks_open(-1, *fn_out, mode, n_threads > 1? n_threads : 0, -1);
+	if (out == 0 || out->fpw == 0) {
+		ks_close(in); ks_close(out);
+		isolate->ThrowError("[k8_sort] failed to open the output file");
+		return;
+	}
+	if (out->fpw == stdout && ks_std_buf[0]) ks_flush(ks_std_buf[0]); // keep the order with print()
+	int64_t ret = k8_sort_file(&c, in, out, mem, n_threads, tmp_dir);
+	ks_close(in);
+	if (out->fpw == stdout) { // don't close stdout
+		out->fpw = 0;
+		ks_close(out);
+		fflush(stdout);
+	} else ks_close(out);
+	if (ret == -1) isolate->ThrowError("[k8_sort] failed to create temporary files");
+	else if (ret < 0) isolate->ThrowError("[k8_sort] failed to read or write");
+	else args.GetReturnValue().Set((double)ret);
 }
 
-static void k8_bytes_length_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+/************************
+ *** The Worker class ***
+ ************************/
+
+#define K8_PORT_MAGIC (0x506f72)
+
+typedef struct { // a bounded queue of byte buffers
+	int32_t n, m, head, closed;
+	kstring_t *a;
+	pthread_mutex_t lock;
+	pthread_cond_t cv;
+} k8_queue_t;
+
+struct k8_worker_s;
+
+typedef struct { // one end of the channel between a worker and its parent
+	uint64_t magic;
+	struct k8_worker_s *w;
+	k8_queue_t *q_send, *q_recv;
+} k8_port_t;
+
+typedef struct k8_worker_s {
+	pthread_t tid;
+	int32_t argc, ret;
+	char **argv; // argv[0] is the script
+	k8_queue_t q_in, q_out; // from the parent to the worker and from the worker to the parent, respectively
+	k8_port_t port[2]; // port[0] for the parent and port[1] for the worker
+} k8_worker_t;
+
+static v8::Platform *k8_platform = 0;
+static v8::Local<v8::Context> k8_create_shell_context(v8::Isolate* isolate);
+
+static __thread int32_t k8_n_child, k8_m_child;
+static __thread k8_worker_t **k8_child; // workers created by this thread and not joined yet; joined when the script of this thread ends
+
+static void k8_queue_init(k8_queue_t *q, int32_t m)
 {
-	v8::HandleScope handle_scope(info.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
-	if (a == 0) return;
-	info.GetReturnValue().Set((int32_t)a->buf.l);
+	q->m = m > 0? m : 1;
+	q->a = K8_CALLOC(kstring_t, q->m);
+	pthread_mutex_init(&q->lock, 0);
+	pthread_cond_init(&q->cv, 0);
 }
 
-static void k8_bytes_length_setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info)
+static void k8_queue_destroy(k8_queue_t *q)
 {
-	v8::HandleScope handle_scope(info.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
-	if (a == 0) return;
-	int64_t len = value->IntegerValue(info.GetIsolate()->GetCurrentContext()).FromMaybe(a->buf.l);
-	if (len > a->buf.m) K8_GROW0(uint8_t, a->buf.s, len - 1, a->buf.m);
-	a->buf.l = len;
+	for (int32_t i = 0; i < q->n; ++i)
+		free(q->a[(q->head + i) % q->m].s);
+	free(q->a);
+	pthread_mutex_destroy(&q->lock);
+	pthread_cond_destroy(&q->cv);
 }
 
-static void k8_bytes_capacity_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+static int32_t k8_queue_push(k8_queue_t *q, kstring_t *s) // take the ownership of s->s; return -1 if the queue is closed
 {
-	v8::HandleScope handle_scope(info.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
-	if (a == 0) return;
-	info.GetReturnValue().Set((int32_t)a->buf.m);
+	pthread_mutex_lock(&q->lock);
+	while (q->n == q->m && !q->closed)
+		pthread_cond_wait(&q->cv, &q->lock);
+	if (q->closed) {
+		pthread_mutex_unlock(&q->lock);
+		return -1;
+	}
+	q->a[(q->head + q->n++) % q->m] = *s;
+	s->l = s->m = 0, s->s = 0;
+	pthread_cond_broadcast(&q->cv);
+	pthread_mutex_unlock(&q->lock);
+	return 0;
 }
 
-static void k8_bytes_capacity_setter(v8::Local<v8::String> property, v8::Local<v8::Value> value, const v8::PropertyCallbackInfo<void> &info)
+static int32_t k8_queue_pop(k8_queue_t *q, kstring_t *s) // the caller takes the ownership; return -1 if the queue is closed and empty
 {
-	v8::HandleScope handle_scope(info.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
-	if (a == 0) return;
-	int64_t len = value->IntegerValue(info.GetIsolate()->GetCurrentContext()).FromMaybe(a->buf.m);
-	if (len < a->buf.l) len = a->buf.l;
-	a->buf.m = len;
-	a->buf.s = K8_REALLOC(uint8_t, a->buf.s, a->buf.m);
+	pthread_mutex_lock(&q->lock);
+	while (q->n == 0 && !q->closed)
+		pthread_cond_wait(&q->cv, &q->lock);
+	if (q->n == 0) {
+		pthread_mutex_unlock(&q->lock);
+		return -1;
+	}
+	*s = q->a[q->head];
+	q->head = (q->head + 1) % q->m, --q->n;
+	pthread_cond_broadcast(&q->cv);
+	pthread_mutex_unlock(&q->lock);
+	return 0;
 }
 
-static void k8_ext_delete_cb(void *data, size_t len, void *aux) {} // do nothing
-
-static void k8_bytes_buffer_getter(v8::Local<v8::String> property, const v8::PropertyCallbackInfo<v8::Value> &info)
+static void k8_queue_close(k8_queue_t *q) // pending messages can still be popped
 {
-	v8::HandleScope handle_scope(info.GetIsolate());
-	k8_bytes_t *a = K8_LOAD_PTR(info, 0, k8_bytes_t);
-	if (a == 0) return;
-	info.GetReturnValue().Set(v8::ArrayBuffer::New(info.GetIsolate(), v8::ArrayBuffer::NewBackingStore((uint8_t*)a->buf.s, a->buf.l, k8_ext_delete_cb, 0)));
+	pthread_mutex_lock(&q->lock);
+	q->closed = 1;
+	pthread_cond_broadcast(&q->cv);
+	pthread_mutex_unlock(&q->lock);
 }
 
-/**********************
- *** The File class ***
- **********************/
+static void k8_port_send(const v8::FunctionCallbackInfo<v8::Value> &args) // send(data): transfer the buffer of a Bytes object or copy a string
+{
+	v8::Isolate *isolate = args.GetIsolate();
+	v8::HandleScope handle_scope(isolate);
+	k8_port_t *p = K8_LOAD_PTR(args, 0, k8_port_t);
+	if (p == 0 || p->magic != K8_PORT_MAGIC || args.Length() == 0) return;
+	k8_bytes_t *a = k8_get_bytes(args[0]);
+	kstring_t tmp = {0,0,0}, *s = &tmp;
+	if (a) {
+		s = &a->buf; // $a becomes empty after sending
+	} else if (args[0]->IsString()) {
+		tmp.l = tmp.m = args[0].As<v8::String>()->Length();
+		tmp.s = K8_MALLOC(uint8_t, tmp.m + 1);
+		args[0].As<v8::String>()->WriteOneByte(isolate, tmp.s);
+	} else {
+		isolate->ThrowError("[k8_port_send] only Bytes and strings can be sent");
+		return;
+	}
+	int32_t ret = k8_queue_push(p->q_send, s);
+	free(tmp.s);
+	if (a) k8_bytes_sync(isolate, a);
+	args.GetReturnValue().Set(ret);
+}
 
-static void k8_file_open(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_port_recv(const v8::FunctionCallbackInfo<v8::Value> &args) // recv(buf): replace the buffer of $buf with the next message
 {
 	v8::Isolate *isolate = args.GetIsolate();
 	v8::HandleScope handle_scope(isolate);
-	k8_file_t *ks = 0;
-	int fd = args.Length() >= 1 && args[0]->IsUint32()? args[0]->Int32Value(isolate->GetCurrentContext()).FromMaybe(-1) : -1;
-	if (args.Length() >= 2) { // File(fn, mode) or File(fd, mode)
-		v8::String::Utf8Value mode(isolate, args[1]);
-		if (fd >= 0) { // File(fd, mode)
-			ks = ks_open(fd, 0, *mode);
-		} else { // File(fn, mode)
-			v8::String::Utf8Value fn(isolate, args[0]);
-			ks = ks_open(-1, *fn, *mode);
-		}
-	} else if (args.Length() == 1) { // File(fn) or File(fd)
-		if (fd >= 0) {
-			ks = ks_open(fd, 0, 0);
-		} else {
-			v8::String::Utf8Value fn(isolate, args[0]);
-			ks = ks_open(-1, *fn, 0);
-		}
-	} else { // File()
-		ks = ks_open(0, 0, 0); // open stdin for reading
+	k8_port_t *p = K8_LOAD_PTR(args, 0, k8_port_t);
+	if (p == 0 || p->magic != K8_PORT_MAGIC) return;
+	k8_bytes_t *a = args.Length() > 0? k8_get_bytes(args[0]) : 0;
+	if (a == 0) {
+		args.GetReturnValue().Set(-2);
+		return;
 	}
-	if (ks) {
-		K8_SAVE_PTR(args, 0, ks);
-	} else {
-		isolate->ThrowError("k8_open: failed to open file");
-		args.GetReturnValue().SetNull();
+	kstring_t s;
+	if (k8_queue_pop(p->q_recv, &s) < 0) {
+		args.GetReturnValue().Set(-1);
+		return;
 	}
+	free(a->buf.s);
+	a->buf = s;
+	k8_bytes_sync(isolate, a);
+	args.GetReturnValue().Set((double)s.l);
 }
 
-static void k8_file_close(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_port_close(const v8::FunctionCallbackInfo<v8::Value> &args) // close(): no more messages will be sent
 {
 	v8::HandleScope handle_scope(args.GetIsolate());
-	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
-	if (ks == 0) return;
-	ks_close(ks);
-	K8_SAVE_PTR(args, 0, 0);
-	args.GetReturnValue().Set(0);
+	k8_port_t *p = K8_LOAD_PTR(args, 0, k8_port_t);
+	if (p == 0 || p->magic != K8_PORT_MAGIC) return;
+	k8_queue_close(p->q_send);
 }
 
-static int32_t k8_get_sep_off(const v8::FunctionCallbackInfo<v8::Value> &args, int32_t *sep)
+static void *k8_worker_main(void *data)
 {
-	v8::Isolate *isolate = args.GetIsolate();
-	*sep = KS_SEP_LINE;
-	if (args.Length() >= 2) {
-		if (args[1]->IsString()) {
-			v8::String::Utf8Value str(isolate, args[0]);
-			*sep = (*str)[0];
-		} else if (args[1]->IsInt32()) {
-			*sep = args[1]->Int32Value(isolate->GetCurrentContext()).FromMaybe(KS_SEP_LINE);
-		}
+	k8_worker_t *w = (k8_worker_t*)data;
+	v8::Isolate::CreateParams create_params;
+	create_params.array_buffer_allocator = v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+	v8::Isolate *isolate = v8::Isolate::New(create_params);
+	w->ret = 1;
+	k8_isolate_add(isolate);
+	{
+		v8::Isolate::Scope isolate_scope(isolate);
+		v8::HandleScope handle_scope(isolate);
+		v8::Local<v8::Context> context = k8_create_shell_context(isolate);
+		v8::Context::Scope context_scope(context);
+		v8::Local<v8::Array> args = v8::Array::New(isolate, w->argc - 1);
+		for (int32_t i = 1; i < w->argc; ++i)
+			args->Set(context, i - 1, v8::String::NewFromUtf8(isolate, w->argv[i]).ToLocalChecked()).FromJust();
+		context->Global()->Set(context, v8::String::NewFromUtf8Literal(isolate, "arguments"), args).FromJust();
+		v8::Local<v8::ObjectTemplate> ot = v8::ObjectTemplate::New(isolate); // the "parent" object
+		ot->SetInternalFieldCount(1);
+		ot->Set(isolate, "send", v8::FunctionTemplate::New(isolate, k8_port_send));
+		ot->Set(isolate, "recv", v8::FunctionTemplate::New(isolate, k8_port_recv));
+		ot->Set(isolate, "close", v8::FunctionTemplate::New(isolate, k8_port_close));
+		v8::Local<v8::Object> parent = ot->NewInstance(context).ToLocalChecked();
+		parent->SetAlignedPointerInInternalField(0, &w->port[1]);
+		context->Global()->Set(context, v8::String::NewFromUtf8Literal(isolate, "parent"), parent).FromJust();
+		v8::Local<v8::String> source;
+		if (k8_readfile(isolate, w->argv[0]).ToLocal(&source)
+				&& k8_execute(isolate, source, v8::String::NewFromUtf8(isolate, w->argv[0]).ToLocalChecked(), false, w->argv[0]))
+			w->ret = 0;
+		if (k8_platform)
+			while (v8::platform::PumpMessageLoop(k8_platform, isolate)) continue;
 	}
-	return args.Length() >= 3? args[2]->Int32Value(isolate->GetCurrentContext()).FromMaybe(0) : 0;
+	k8_worker_join_all();
+	k8_isolate_del(isolate);
+	ks_flush_live();
+	ks_std_destroy();
+	isolate->Dispose();
+	delete create_params.array_buffer_allocator;
+	k8_queue_close(&w->q_out); // the parent gets -1 from recv() after all messages are received
+	k8_queue_close(&w->q_in); // so that the parent does not block on sending
+	return 0;
 }
 
-static void k8_file_readline(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_worker_new(const v8::FunctionCallbackInfo<v8::Value> &args) // Worker(fn, args?, opt?)
 {
 	v8::Isolate *isolate = args.GetIsolate();
 	v8::HandleScope handle_scope(isolate);
-	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
-	if (ks == 0) return;
-	if (!args.Length() || !args[0]->IsObject()) {
-		args.GetReturnValue().Set(-2);
+	v8::Local<v8::Context> context = isolate->GetCurrentContext();
+	if (args.Length() == 0) {
+		isolate->ThrowError("[k8_worker_new] the script is not specified");
 		return;
 	}
-	v8::Handle<v8::Object> b = v8::Handle<v8::Object>::Cast(args[0]);
-	k8_bytes_t *a = (k8_bytes_t*)b->GetAlignedPointerFromInternalField(0);
-	if (a->magic != K8_BYTES_MAGIC) {
-		args.GetReturnValue().Set(-2);
-	} else {
-		int32_t dret, sep;
-		a->buf.l = k8_get_sep_off(args, &sep);
-		int64_t ret = ks_getuntil2(ks, sep, &a->buf, &dret, 1);
-		if (ret >= 0) args.GetReturnValue().Set(dret);
-		else args.GetReturnValue().Set((int32_t)ret);
+	k8_worker_t *w = K8_CALLOC(k8_worker_t, 1);
+	v8::Local<v8::Array> array;
+	if (args.Length() >= 2 && args[1]->IsArray()) array = args[1].As<v8::Array>();
+	w->argc = 1 + (array.IsEmpty()? 0 : array->Length());
+	w->argv = K8_CALLOC(char*, w->argc);
+	for (int32_t i = 0; i < w->argc; ++i) {
+		v8::Local<v8::Value> x = args[0];
+		if (i > 0 && !array->Get(context, i - 1).ToLocal(&x)) x = v8::String::Empty(isolate);
+		v8::String::Utf8Value str(isolate, x);
+		w->argv[i] = strdup(k8_cstr(str));
 	}
+	int32_t m = args.Length() >= 3? k8_get_opt_int(isolate, args[2], "queue", 16) : 16;
+	k8_queue_init(&w->q_in, m);
+	k8_queue_init(&w->q_out, m);
+	w->port[0].magic = w->port[1].magic = K8_PORT_MAGIC;
+	w->port[0].w = w->port[1].w = w;
+	w->port[0].q_send = w->port[1].q_recv = &w->q_in;
+	w->port[0].q_recv = w->port[1].q_send = &w->q_out;
+	if (pthread_create(&w->tid, 0, k8_worker_main, w) != 0) {
+		isolate->ThrowError("[k8_worker_new] failed to create the thread");
+		k8_queue_destroy(&w->q_in); k8_queue_destroy(&w->q_out);
+		for (int32_t i = 0; i < w->argc; ++i) free(w->argv[i]);
+		free(w->argv); free(w);
+		return;
+	}
+	K8_GROW(k8_worker_t*, k8_child, k8_n_child, k8_m_child);
+	k8_child[k8_n_child++] = w;
+	K8_SAVE_PTR(args, 0, &w->port[0]);
 }
 
-static void k8_file_read(const v8::FunctionCallbackInfo<v8::Value> &args)
+static int32_t k8_worker_free(k8_worker_t *w) // wait for the worker to finish and free it; return the exit status of the worker
 {
-	v8::Isolate *isolate = args.GetIsolate();
-	v8::HandleScope handle_scope(isolate);
-	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
-	if (ks == 0) return;
-	if (args.Length() == 0) { // prototype.read()
-		int32_t c = ks_getc(ks);
-		args.GetReturnValue().Set(c);
-	} else if (args.Length() >= 1 && args[0]->IsObject()) {
-		v8::Handle<v8::Object> b = v8::Handle<v8::Object>::Cast(args[0]);
-		k8_bytes_t *a = (k8_bytes_t*)b->GetAlignedPointerFromInternalField(0);
-		if (a->magic != K8_BYTES_MAGIC) { // TODO: well, there got to be a better way
-			args.GetReturnValue().Set(-2);
-			return;
-		}
-		uint32_t off = a->buf.l;
-		if (args.Length() >= 2 && args[1]->IsUint32())
-			off = args[1]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
-		if (args.Length() == 3 && args[1]->IsUint32() && args[2]->IsUint32()) { // prototype.read(bytes, off, len)
-			uint32_t len = args[2]->Uint32Value(isolate->GetCurrentContext()).FromMaybe(0);
-			K8_GROW(uint8_t, a->buf.s, off + len - 1, a->buf.m);
-			int64_t ret = ks_read(ks, &a->buf.s[off], len);
-			if (ret > 0 && a->buf.l < off + ret) a->buf.l = off + ret;
-			args.GetReturnValue().Set((int32_t)ret);
-		} else if (args.Length() == 1 || (args.Length() == 2 && args[1]->IsUint32())) { // prototype.read(bytes) or prototype.read(bytes, off)
-			kstring_t tmp = {0,0,0};
-			ks_read_all(ks, &tmp);
-			K8_GROW(uint8_t, a->buf.s, off + tmp.l, a->buf.m);
-			memcpy(&a->buf.s[off], tmp.s, tmp.l);
-			a->buf.l = off + tmp.l;
-			free(tmp.s);
-			args.GetReturnValue().Set((int32_t)tmp.l);
+	int32_t i, ret;
+	for (i = 0; i < k8_n_child; ++i)
+		if (k8_child[i] == w) {
+			memmove(&k8_child[i], &k8_child[i + 1], (k8_n_child - i - 1) * sizeof(k8_worker_t*));
+			--k8_n_child;
+			break;
 		}
-	}
+	k8_queue_close(&w->q_in);
+	k8_queue_close(&w->q_out); // a worker blocked in send() on a full queue gets -1 instead of waiting forever
+	pthread_join(w->tid, 0);
+	ret = w->ret;
+	k8_queue_destroy(&w->q_in);
+	k8_queue_destroy(&w->q_out);
+	for (i = 0; i < w->argc; ++i) free(w->argv[i]);
+	free(w->argv);
+	memset(w, 0, sizeof(*w));
+	free(w);
+	return ret;
 }
 
-static void k8_file_write(const v8::FunctionCallbackInfo<v8::Value> &args)
+static void k8_worker_join_all(void) // join workers not joined by the script
+{
+	while (k8_n_child > 0)
+		k8_worker_free(k8_child[0]);
+	free(k8_child);
+	k8_child = 0, k8_m_child = 0;
+}
+
+static void k8_worker_join(const v8::FunctionCallbackInfo<v8::Value> &args) // join(): wait for the worker to finish; return 0 on success
 {
 	v8::HandleScope handle_scope(args.GetIsolate());
-	k8_file_t *ks = K8_LOAD_PTR(args, 0, k8_file_t);
-	if (ks == 0) return;
-	if (ks->magic != K8_FILE_MAGIC || ks->fpw == 0) {
-		args.GetReturnValue().Set(-1);
-		return;
-	} else if (args[0]->IsArrayBuffer()) {
-		void *data = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->Data();
-		int64_t len = args[0].As<v8::ArrayBuffer>()->GetBackingStore()->ByteLength();
-		assert(len >= 0 && len < INT32_MAX);
-		if (len > 0) fwrite(data, 1, len, ks->fpw);
-		args.GetReturnValue().Set((int32_t)len);
-	} else if (args[0]->IsString()) {
-		int32_t len = args[0].As<v8::String>()->Length();
-		uint8_t *buf;
-		buf = K8_MALLOC(uint8_t, len);
-		args[0].As<v8::String>()->WriteOneByte(args.GetIsolate(), buf);
-		if (len > 0) fwrite(buf, 1, len, ks->fpw);
-		free(buf);
-		args.GetReturnValue().Set(len);
-	}
+	k8_port_t *p = K8_LOAD_PTR(args, 0, k8_port_t);
+	if (p == 0 || p->magic != K8_PORT_MAGIC) return;
+	args.GetReturnValue().Set(k8_worker_free(p->w));
+	K8_SAVE_PTR(args, 0, 0);
 }
 
 /***********************
@@ -900,6 +5258,142 @@ int getopt(int nargc, char * const *nargv, const char *ostr)
 	return optopt;
 }
 
+/************************
+ *** Startup snapshot ***
+ ************************/
+
+static const intptr_t k8_ext_refs[] = { // all callbacks used in k8_create_shell_context(); required by snapshots
+	(intptr_t)k8_print, (intptr_t)k8_warn, (intptr_t)k8_exit, (intptr_t)k8_load, (intptr_t)k8_read_file,
+	(intptr_t)k8_encode, (intptr_t)k8_decode, (intptr_t)k8_revcomp, (intptr_t)k8_version,
+	(intptr_t)k8_nt4, (intptr_t)k8_pack2, (intptr_t)k8_unpack2, (intptr_t)k8_count_gcn, (intptr_t)k8_kmer_hash, (intptr_t)k8_sort,
+	(intptr_t)k8_bytes_new, (intptr_t)k8_bytes_length_getter, (intptr_t)k8_bytes_length_setter,
+	(intptr_t)k8_bytes_capacity_getter, (intptr_t)k8_bytes_capacity_setter, (intptr_t)k8_bytes_buffer_getter,
+	(intptr_t)k8_bytes_destroy, (intptr_t)k8_bytes_set, (intptr_t)k8_bytes_toString, (intptr_t)k8_bytes_intern, (intptr_t)k8_bytes_fields,
+	(intptr_t)k8_bytes_field, (intptr_t)k8_bytes_parseInt, (intptr_t)k8_bytes_parseFloat, (intptr_t)k8_bytes_parseColumn,
+	(intptr_t)k8_file_open, (intptr_t)k8_file_read, (intptr_t)k8_file_readline, (intptr_t)k8_file_readlines,
+	(intptr_t)k8_file_readFastx, (intptr_t)k8_file_write, (intptr_t)k8_file_flush, (intptr_t)k8_file_close, (intptr_t)k8_file_stats,
+	(intptr_t)k8_file_tell, (intptr_t)k8_file_seek, (intptr_t)k8_file_readRange, (intptr_t)k8_file_loadIndex, (intptr_t)k8_file_saveIndex,
+	(intptr_t)k8_iidx_new, (intptr_t)k8_iidx_fromBed, (intptr_t)k8_iidx_length_getter, (intptr_t)k8_iidx_add,
+	(intptr_t)k8_iidx_index_js, (intptr_t)k8_iidx_overlap_js,
+	(intptr_t)k8_bmap_new, (intptr_t)k8_bcnt_new, (intptr_t)k8_bmap_size_getter, (intptr_t)k8_bmap_get_js, (intptr_t)k8_bmap_has,
+	(intptr_t)k8_bmap_set, (intptr_t)k8_bmap_inc, (intptr_t)k8_bmap_key, (intptr_t)k8_bmap_value, (intptr_t)k8_bmap_entries,
+	(intptr_t)k8_bmap_clear_js,
+	(intptr_t)k8_tbx_new, (intptr_t)k8_tbx_query_js, (intptr_t)k8_tbx_next_js, (intptr_t)k8_tbx_names, (intptr_t)k8_tbx_saveIndex,
+	(intptr_t)k8_tbx_close,
+	(intptr_t)k8_worker_new, (intptr_t)k8_port_send, (intptr_t)k8_port_recv, (intptr_t)k8_port_close, (intptr_t)k8_worker_join,
+	0
+};
+
+static v8::StartupData k8_serialize_field(v8::Local<v8::Object> holder, int index, void *data) // keep the content of Bytes; drop other native objects
+{
+	v8::StartupData ret = { 0, 0 };
+	uint64_t *p = (uint64_t*)holder->GetAlignedPointerFromInternalField(index);
+	if (p == 0) return ret;
+	if (*p == K8_BYTES_MAGIC) {
+		k8_bytes_t *a = (k8_bytes_t*)p;
+		char *s = new char[sizeof(uint64_t) + a->buf.l];
+		memcpy(s, &a->magic, sizeof(uint64_t));
+		if (a->buf.l) memcpy(s + sizeof(uint64_t), a->buf.s, a->buf.l);
+		ret.data = s, ret.raw_size = sizeof(uint64_t) + a->buf.l;
+	} else { // a File or a Worker can't be restored; a non-empty payload makes V8 clear the field
+		char *s = new char[sizeof(uint64_t)];
+		memset(s, 0, sizeof(uint64_t));
+		ret.data = s, ret.raw_size = sizeof(uint64_t);
+	}
+	return ret;
+}
+
+static void k8_deserialize_field(v8::Local<v8::Object> holder, int index, v8::StartupData payload, void *data)
+{
+	uint64_t magic;
+	k8_bytes_t *a = 0;
+	if (payload.raw_size < (int)sizeof(uint64_t)) return;
+	memcpy(&magic, payload.data, sizeof(uint64_t));
+	if (magic == K8_BYTES_MAGIC) {
+		a = K8_CALLOC(k8_bytes_t, 1);
+		a->magic = K8_BYTES_MAGIC;
+		a->buf.l = a->buf.m = payload.raw_size - sizeof(uint64_t);
+		if (a->buf.l) {
+			a->buf.s = K8_MALLOC(uint8_t, a->buf.m);
+			memcpy(a->buf.s, payload.data + sizeof(uint64_t), a->buf.l);
+		}
+	}
+	holder->SetAlignedPointerInInternalField(index, a);
+	if (a) k8_bytes_track(holder->GetIsolate(), holder, a);
+}
+
+static int k8_long_opt(int *argc, char *argv[], const char **fn) // parse and remove the k8 long options before the script name; *fn is set to "" by --no-snapshot
+{
+	int i, j, make = 0;
+	for (i = j = 1; i < *argc && argv[i][0] == '-' && argv[i][1]; ++i) {
+		if (strncmp(argv[i], "--cpu-profile=", 14) == 0) {
+			k8_prof_fn = argv[i] + 14;
+		} else if (strncmp(argv[i], "--cpu-profile-interval=", 23) == 0) {
+			k8_prof_intv = atoi(argv[i] + 23);
+			if (k8_prof_intv <= 0) k8_prof_intv = 1000;
+		} else if (strcmp(argv[i], "--stats") == 0) {
+			k8_stats_on = 1;
+		} else if (strcmp(argv[i], "--make-snapshot") == 0) {
+			make = 1;
+		} else if (strcmp(argv[i], "--no-snapshot") == 0) {
+			*fn = "";
+		} else if (strncmp(argv[i], "--snapshot=", 11) == 0) {
+			*fn = argv[i] + 11;
+		} else if (strcmp(argv[i], "--snapshot") == 0 && i + 1 < *argc) {
+			*fn = argv[++i];
+		} else {
+			argv[j++] = argv[i];
+			if (argv[i][2] == 0 && strchr("eEmM", argv[i][1]) && i + 1 < *argc) // options taking an argument
+				argv[j++] = argv[++i];
+		}
+	}
+	for (; i < *argc; ++i) argv[j++] = argv[i];
+	*argc = j;
+	return make;
+}
+
+static int k8_snapshot_load(const char *fn, v8::StartupData *blob) // read a snapshot to $blob; return 0 on success
+{
+	FILE *fp;
+	struct stat st;
+	char *s;
+	blob->data = 0, blob->raw_size = 0;
+	if ((fp = fopen(fn, "rb")) == 0) return -1;
+	if (fstat(fileno(fp), &st) < 0 || st.st_size <= 0 || st.st_size > INT32_MAX) {
+		fclose(fp);
+		return -1;
+	}
+	s = new char[st.st_size];
+	if (fread(s, 1, st.st_size, fp) != (size_t)st.st_size) {
+		delete[] s;
+		fclose(fp);
+		return -1;
+	}
+	fclose(fp);
+	blob->data = s, blob->raw_size = st.st_size;
+	if (!blob->IsValid()) { // built by a different binary
+		delete[] s;
+		blob->data = 0, blob->raw_size = 0;
+		return -2;
+	}
+	return 0;
+}
+
+static const char *k8_snapshot_default(const char *argv0, char *fn) // <executable>.blob if present
+{
+	int32_t l = -1;
+#ifdef __linux__
+	l = readlink("/proc/self/exe", fn, K8_PATH_MAX - 5);
+#endif
+	if (l < 0) {
+		if (strchr(argv0, '/') == 0 || strlen(argv0) >= K8_PATH_MAX - 5) return 0;
+		l = strlen(argv0);
+		memcpy(fn, argv0, l);
+	}
+	strcpy(&fn[l], ".blob");
+	return access(fn, R_OK) == 0? fn : 0;
+}
+
 /*********************
  *** Main function ***
  *********************/
@@ -916,6 +5410,12 @@ static v8::Local<v8::Context> k8_create_shell_context(v8::Isolate* isolate)
 	global->Set(isolate, "k8_decode", v8::FunctionTemplate::New(isolate, k8_decode));
 	global->Set(isolate, "k8_revcomp", v8::FunctionTemplate::New(isolate, k8_revcomp));
 	global->Set(isolate, "k8_version", v8::FunctionTemplate::New(isolate, k8_version));
+	global->Set(isolate, "k8_nt4", v8::FunctionTemplate::New(isolate, k8_nt4));
+	global->Set(isolate, "k8_pack2", v8::FunctionTemplate::New(isolate, k8_pack2));
+	global->Set(isolate, "k8_unpack2", v8::FunctionTemplate::New(isolate, k8_unpack2));
+	global->Set(isolate, "k8_count_gcn", v8::FunctionTemplate::New(isolate, k8_count_gcn));
+	global->Set(isolate, "k8_kmer_hash", v8::FunctionTemplate::New(isolate, k8_kmer_hash));
+	global->Set(isolate, "k8_sort", v8::FunctionTemplate::New(isolate, k8_sort));
 	{ // add the 'Bytes' object
 		v8::HandleScope scope(isolate);
 		v8::Handle<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate, k8_bytes_new);
@@ -931,6 +5431,12 @@ static v8::Local<v8::Context> k8_create_shell_context(v8::Isolate* isolate)
 		pt->Set(isolate, "destroy", v8::FunctionTemplate::New(isolate, k8_bytes_destroy));
 		pt->Set(isolate, "set", v8::FunctionTemplate::New(isolate, k8_bytes_set));
 		pt->Set(isolate, "toString", v8::FunctionTemplate::New(isolate, k8_bytes_toString));
+		pt->Set(isolate, "intern", v8::FunctionTemplate::New(isolate, k8_bytes_intern));
+		pt->Set(isolate, "fields", v8::FunctionTemplate::New(isolate, k8_bytes_fields));
+		pt->Set(isolate, "field", v8::FunctionTemplate::New(isolate, k8_bytes_field));
+		pt->Set(isolate, "parseInt", v8::FunctionTemplate::New(isolate, k8_bytes_parseInt));
+		pt->Set(isolate, "parseFloat", v8::FunctionTemplate::New(isolate, k8_bytes_parseFloat));
+		pt->Set(isolate, "parseColumn", v8::FunctionTemplate::New(isolate, k8_bytes_parseColumn));
 		global->Set(isolate, "Bytes", ft);
 	}
 	{ // add the 'File' object
@@ -944,11 +5450,94 @@ static v8::Local<v8::Context> k8_create_shell_context(v8::Isolate* isolate)
 		v8::Handle<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
 		pt->Set(isolate, "read", v8::FunctionTemplate::New(isolate, k8_file_read));
 		pt->Set(isolate, "readline", v8::FunctionTemplate::New(isolate, k8_file_readline));
+		pt->Set(isolate, "readlines", v8::FunctionTemplate::New(isolate, k8_file_readlines));
+		pt->Set(isolate, "readFastx", v8::FunctionTemplate::New(isolate, k8_file_readFastx));
 		pt->Set(isolate, "write", v8::FunctionTemplate::New(isolate, k8_file_write));
+		pt->Set(isolate, "flush", v8::FunctionTemplate::New(isolate, k8_file_flush));
+		pt->Set(isolate, "stats", v8::FunctionTemplate::New(isolate, k8_file_stats));
+		pt->Set(isolate, "tell", v8::FunctionTemplate::New(isolate, k8_file_tell));
+		pt->Set(isolate, "seek", v8::FunctionTemplate::New(isolate, k8_file_seek));
+		pt->Set(isolate, "readRange", v8::FunctionTemplate::New(isolate, k8_file_readRange));
+		pt->Set(isolate, "loadIndex", v8::FunctionTemplate::New(isolate, k8_file_loadIndex));
+		pt->Set(isolate, "saveIndex", v8::FunctionTemplate::New(isolate, k8_file_saveIndex));
 		pt->Set(isolate, "close", v8::FunctionTemplate::New(isolate, k8_file_close));
 		pt->Set(isolate, "destroy", v8::FunctionTemplate::New(isolate, k8_file_close));
 		global->Set(isolate, "File", ft);
 	}
+	{ // add the 'IntervalIndex' object
+		v8::HandleScope scope(isolate);
+		v8::Handle<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate, k8_iidx_new);
+		ft->SetClassName(v8::String::NewFromUtf8Literal(isolate, "IntervalIndex"));
+		ft->Set(isolate, "fromBed", v8::FunctionTemplate::New(isolate, k8_iidx_fromBed));
+
+		v8::Handle<v8::ObjectTemplate> ot = ft->InstanceTemplate();
+		ot->SetInternalFieldCount(1);
+		ot->SetAccessor(v8::String::NewFromUtf8Literal(isolate, "length"), k8_iidx_length_getter);
+
+		v8::Handle<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+		pt->Set(isolate, "add", v8::FunctionTemplate::New(isolate, k8_iidx_add));
+		pt->Set(isolate, "index", v8::FunctionTemplate::New(isolate, k8_iidx_index_js));
+		pt->Set(isolate, "overlap", v8::FunctionTemplate::New(isolate, k8_iidx_overlap_js));
+		global->Set(isolate, "IntervalIndex", ft);
+	}
+	{ // add the 'ByteMap' and 'ByteCounter' objects
+		v8::HandleScope scope(isolate);
+		v8::Handle<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate, k8_bmap_new);
+		ft->SetClassName(v8::String::NewFromUtf8Literal(isolate, "ByteMap"));
+
+		v8::Handle<v8::ObjectTemplate> ot = ft->InstanceTemplate();
+		ot->SetInternalFieldCount(1);
+		ot->SetAccessor(v8::String::NewFromUtf8Literal(isolate, "size"), k8_bmap_size_getter);
+
+		v8::Handle<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+		pt->Set(isolate, "get", v8::FunctionTemplate::New(isolate, k8_bmap_get_js));
+		pt->Set(isolate, "has", v8::FunctionTemplate::New(isolate, k8_bmap_has));
+		pt->Set(isolate, "set", v8::FunctionTemplate::New(isolate, k8_bmap_set));
+		pt->Set(isolate, "inc", v8::FunctionTemplate::New(isolate, k8_bmap_inc));
+		pt->Set(isolate, "key", v8::FunctionTemplate::New(isolate, k8_bmap_key));
+		pt->Set(isolate, "value", v8::FunctionTemplate::New(isolate, k8_bmap_value));
+		pt->Set(isolate, "entries", v8::FunctionTemplate::New(isolate, k8_bmap_entries));
+		pt->Set(isolate, "clear", v8::FunctionTemplate::New(isolate, k8_bmap_clear_js));
+		global->Set(isolate, "ByteMap", ft);
+
+		v8::Handle<v8::FunctionTemplate> fc = v8::FunctionTemplate::New(isolate, k8_bcnt_new); // ByteCounter only differs in the constructor
+		fc->SetClassName(v8::String::NewFromUtf8Literal(isolate, "ByteCounter"));
+		fc->Inherit(ft);
+		fc->InstanceTemplate()->SetInternalFieldCount(1);
+		global->Set(isolate, "ByteCounter", fc);
+	}
+	{ // add the 'TabixReader' object
+		v8::HandleScope scope(isolate);
+		v8::Handle<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate, k8_tbx_new);
+		ft->SetClassName(v8::String::NewFromUtf8Literal(isolate, "TabixReader"));
+
+		v8::Handle<v8::ObjectTemplate> ot = ft->InstanceTemplate();
+		ot->SetInternalFieldCount(1);
+
+		v8::Handle<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+		pt->Set(isolate, "query", v8::FunctionTemplate::New(isolate, k8_tbx_query_js));
+		pt->Set(isolate, "next", v8::FunctionTemplate::New(isolate, k8_tbx_next_js));
+		pt->Set(isolate, "names", v8::FunctionTemplate::New(isolate, k8_tbx_names));
+		pt->Set(isolate, "saveIndex", v8::FunctionTemplate::New(isolate, k8_tbx_saveIndex));
+		pt->Set(isolate, "close", v8::FunctionTemplate::New(isolate, k8_tbx_close));
+		pt->Set(isolate, "destroy", v8::FunctionTemplate::New(isolate, k8_tbx_close));
+		global->Set(isolate, "TabixReader", ft);
+	}
+	{ // add the 'Worker' object
+		v8::HandleScope scope(isolate);
+		v8::Handle<v8::FunctionTemplate> ft = v8::FunctionTemplate::New(isolate, k8_worker_new);
+		ft->SetClassName(v8::String::NewFromUtf8Literal(isolate, "Worker"));
+
+		v8::Handle<v8::ObjectTemplate> ot = ft->InstanceTemplate();
+		ot->SetInternalFieldCount(1);
+
+		v8::Handle<v8::ObjectTemplate> pt = ft->PrototypeTemplate();
+		pt->Set(isolate, "send", v8::FunctionTemplate::New(isolate, k8_port_send));
+		pt->Set(isolate, "recv", v8::FunctionTemplate::New(isolate, k8_port_recv));
+		pt->Set(isolate, "close", v8::FunctionTemplate::New(isolate, k8_port_close));
+		pt->Set(isolate, "join", v8::FunctionTemplate::New(isolate, k8_worker_join));
+		global->Set(isolate, "Worker", ft);
+	}
 	return v8::Context::New(isolate, NULL, global);
 }
 
@@ -962,11 +5551,15 @@ static int k8_main(v8::Isolate *isolate, v8::Platform *platform, v8::Local<v8::C
 			v8::Local<v8::String> source;
 			if (!v8::String::NewFromUtf8(isolate, optarg).ToLocal(&source))
 				return 1;
-			bool success = k8_execute(isolate, source, file_name, (c == 'E'));
+			k8_prof_start(isolate);
+			k8_stats_start(isolate);
+			bool success = k8_execute(isolate, source, file_name, (c == 'E'), 0);
 			while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
+			k8_prof_stop(isolate);
+			k8_stats_report(isolate);
 			return success? 0 : 1;
 		} else if (c == 'v') {
-			printf("v8: %s\nk8: %s\n", v8::V8::GetVersion(), K8_VERSION);
+			printf("v8: %s\nk8: %s\nsimd: %s\n", v8::V8::GetVersion(), K8_VERSION, k8_sk_get()->name);
 			return 0;
 		} else if (c == 'm' || c == 'M') { // do nothing as this has been parsed in k8_set_mem
 		} else {
@@ -981,6 +5574,12 @@ static int k8_main(v8::Isolate *isolate, v8::Platform *platform, v8::Local<v8::C
 		fprintf(stderr, "  -E STR      execute STR and print results\n");
 		fprintf(stderr, "  -m INT      v8 max size of the old space (in Mbytes) [16384]\n");
 		fprintf(stderr, "  -v          print version number\n");
+		fprintf(stderr, "  --snapshot FILE       start from a snapshot [<k8>.blob if present]\n");
+		fprintf(stderr, "  --no-snapshot         don't look for <k8>.blob\n");
+		fprintf(stderr, "  --make-snapshot OUT   evaluate the scripts on the command line and save a snapshot to OUT\n");
+		fprintf(stderr, "  --cpu-profile=OUT     write folded stacks and a .cpuprofile named after OUT\n");
+		fprintf(stderr, "  --cpu-profile-interval=INT  sampling interval in microseconds [1000]\n");
+		fprintf(stderr, "  --stats     print I/O, heap and GC statistics to stderr at exit\n");
 		fprintf(stderr, "  --help      show v8 command-line options\n");
 		return 0;
 	}
@@ -1000,11 +5599,60 @@ static int k8_main(v8::Isolate *isolate, v8::Platform *platform, v8::Local<v8::C
 		fprintf(stderr, "ERROR: failed to read file '%s'\n", argv[optind]);
 		return 1;
 	}
-	bool success = k8_execute(isolate, source, file_name, false);
+	k8_prof_start(isolate);
+	k8_stats_start(isolate);
+	bool success = k8_execute(isolate, source, file_name, false, argv[optind]);
 	while (v8::platform::PumpMessageLoop(platform, isolate)) continue;
+	k8_prof_stop(isolate);
+	k8_stats_report(isolate);
 	return success? 0 : 1;
 }
 
+static int k8_make_snapshot(int argc, char *argv[]) // k8 --make-snapshot out.blob lib1.js [lib2.js ...]
+{
+	int c, ret = 0;
+	FILE *fp;
+	v8::StartupData blob;
+	while ((c = getopt(argc, argv, "e:E:vM:m:")) >= 0);
+	if (optind + 1 >= argc) {
+		fprintf(stderr, "Usage: k8 --make-snapshot <out.blob> <lib.js> [...]\n");
+		return 1;
+	}
+	k8_making_snapshot = 1;
+	{
+		v8::SnapshotCreator creator(k8_ext_refs);
+		v8::Isolate *isolate = creator.GetIsolate();
+		{
+			v8::HandleScope handle_scope(isolate);
+			v8::Local<v8::Context> context = k8_create_shell_context(isolate);
+			v8::Context::Scope context_scope(context);
+			v8::Local<v8::Private> key = v8::Private::ForApi(isolate, v8::String::NewFromUtf8Literal(isolate, "k8_preloaded"));
+			context->Global()->SetPrivate(context, key, v8::Array::New(isolate)).FromJust();
+			for (int i = optind + 1; i < argc && ret == 0; ++i) { // evaluate libraries in the order on the command line
+				v8::HandleScope scope(isolate);
+				v8::Local<v8::String> source;
+				k8_src_path = argv[i];
+				if (!k8_readfile(isolate, argv[i]).ToLocal(&source)) {
+					fprintf(stderr, "ERROR: failed to read file '%s'\n", argv[i]);
+					ret = 1;
+				} else if (!k8_preloaded(isolate, argv[i]) && !k8_execute(isolate, source, v8::String::NewFromUtf8(isolate, argv[i]).ToLocalChecked(), false, 0))
+					ret = 1;
+			}
+			creator.SetDefaultContext(context, v8::SerializeInternalFieldsCallback(k8_serialize_field, 0));
+		}
+		blob = creator.CreateBlob(v8::SnapshotCreator::FunctionCodeHandling::kKeep);
+	}
+	if (ret == 0) {
+		if ((fp = fopen(argv[optind], "wb")) == 0 || fwrite(blob.data, 1, blob.raw_size, fp) != (size_t)blob.raw_size) {
+			fprintf(stderr, "ERROR: failed to write file '%s'\n", argv[optind]);
+			ret = 1;
+		}
+		if (fp) fclose(fp);
+	}
+	delete[] blob.data;
+	return ret;
+}
+
 void k8_set_mem(int argc, char *argv[])
 {
 	int c;
@@ -1022,21 +5670,51 @@ void k8_set_mem(int argc, char *argv[])
 
 int main(int argc, char *argv[])
 {
-	int ret = 0;
+	int ret = 0, make;
+	const char *fn_snapshot = 0;
+	char buf[K8_PATH_MAX+1];
+	v8::StartupData blob = { 0, 0 };
+	make = k8_long_opt(&argc, argv, &fn_snapshot);
 	k8_set_mem(argc, argv);
 	v8::V8::InitializeICUDefaultLocation(argv[0]);
 	v8::V8::InitializeExternalStartupData(argv[0]);
 	std::unique_ptr<v8::Platform> platform = v8::platform::NewDefaultPlatform();
 	v8::V8::InitializePlatform(platform.get());
+	k8_platform = platform.get();
 	v8::V8::SetFlagsFromCommandLine(&argc, argv, true);
 	v8::V8::Initialize();
+	if (make) {
+		ret = k8_make_snapshot(argc, argv);
+		ks_std_destroy();
+		v8::V8::Dispose();
+		v8::V8::DisposePlatform();
+		return ret;
+	}
+	if (fn_snapshot && *fn_snapshot) { // a snapshot given on the command line must be usable
+		if (k8_snapshot_load(fn_snapshot, &blob) < 0) {
+			fprintf(stderr, "ERROR: failed to load snapshot '%s'\n", fn_snapshot);
+			return 1;
+		}
+	} else if (fn_snapshot == 0 && (fn_snapshot = k8_snapshot_default(argv[0], buf)) != 0) {
+		k8_snapshot_load(fn_snapshot, &blob); // silently ignore a stale snapshot
+	}
 	v8::Isolate::CreateParams create_params;
 	create_params.array_buffer_allocator = v8::ArrayBuffer::Allocator::NewDefaultAllocator();
+	if (blob.data) {
+		create_params.snapshot_blob = &blob;
+		create_params.external_references = k8_ext_refs;
+	}
 	v8::Isolate* isolate = v8::Isolate::New(create_params);
+	k8_main_isolate = isolate;
+	k8_isolate_add(isolate);
 	{
 		v8::Isolate::Scope isolate_scope(isolate);
 		v8::HandleScope handle_scope(isolate);
-		v8::Local<v8::Context> context = k8_create_shell_context(isolate);
+		v8::Local<v8::Context> context;
+		if (blob.data) // the globals are in the snapshot
+			context = v8::Context::New(isolate, NULL, v8::MaybeLocal<v8::ObjectTemplate>(), v8::MaybeLocal<v8::Value>(),
+									   v8::DeserializeInternalFieldsCallback(k8_deserialize_field, 0));
+		else context = k8_create_shell_context(isolate);
 		if (context.IsEmpty()) {
 			fprintf(stderr, "ERROR: failed to create context\n");
 			return 1;
@@ -1044,9 +5722,15 @@ int main(int argc, char *argv[])
 		v8::Context::Scope context_scope(context);
 		ret = k8_main(isolate, platform.get(), context, argc, argv);
 	}
+	k8_worker_join_all();
+	k8_isolate_del(isolate);
+	if (k8_exit_req) ret = k8_exit_code; // exit() called from a worker
+	ks_flush_live();
+	ks_std_destroy();
 	isolate->Dispose();
 	v8::V8::Dispose();
 	v8::V8::DisposePlatform();
 	delete create_params.array_buffer_allocator;
+	delete[] blob.data;
 	return ret;
 }
@@ -1,46 +1,40 @@
 #!/usr/bin/env k8
 
-load("k8.js");
-
 function main(args)
 {
 	if (args.length < 2) {
 		print("Usage: bedcov.js <loaded.bed> <streamed.bed>");
 		return;
 	}
-	let bed = {}, file, buf = new Bytes();
-	file = new File(args[0]);
-	while (file.readline(buf) >= 0) {
-		const t = buf.toString().split("\t", 3);
-		if (bed[t[0]] == null) bed[t[0]] = [];
-		bed[t[0]].push([parseInt(t[1]), parseInt(t[2]), 0]);
-	}
-	for (const ctg in bed) iit_index(bed[ctg]);
-	file.close();
-
+	const bed = IntervalIndex.fromBed(args[0]);
+	let file, buf = new Bytes(), off = new Int32Array(6), a = new Float64Array(3 * 1024);
 	file = new File(args[1]);
 	while (file.readline(buf) >= 0) {
-		const t = buf.toString().split("\t", 3);
+		buf.fields(1, off);
+		const t = [buf.toString(off[0], off[1]), buf.toString(off[2], off[3]), buf.toString(off[4], off[5])];
 		if (bed[t[0]] == null) {
 			print(t[0], t[1], t[2], 0, 0);
 		} else {
-			const st0 = parseInt(t[1]), en0 = parseInt(t[2]);
-			const a = iit_overlap(bed[t[0]], st0, en0);
+			const st0 = buf.parseInt(off[2], off[3]), en0 = buf.parseInt(off[4], off[5]);
+			let n = bed[t[0]].overlap(st0, en0, a);
+			if (n * 3 > a.length) { // enlarge the output array and query again
+				a = new Float64Array(3 * n);
+				n = bed[t[0]].overlap(st0, en0, a);
+			}
 			let cov_st = 0, cov_en = 0, cov = 0;
-			for (let i = 0; i < a.length; ++i) {
-				const st1 = a[i][0] > st0? a[i][0] : st0;
-				const en1 = a[i][1] < en0? a[i][1] : en0;
+			for (let i = 0; i < n; ++i) { // hits are sorted by start
+				const st1 = a[i*3] > st0? a[i*3] : st0;
+				const en1 = a[i*3+1] < en0? a[i*3+1] : en0;
 				if (st1 > cov_en) {
 					cov += cov_en - cov_st;
 					cov_st = st1, cov_en = en1;
 				} else cov_en = cov_en > en1? cov_en : en1;
 			}
 			cov += cov_en - cov_st;
-			print(t[0], t[1], t[2], a.length, cov);
+			print(t[0], t[1], t[2], n, cov);
 		}
 	}
 	file.close();
-	buf.destroy();
 }
 
 main(arguments);